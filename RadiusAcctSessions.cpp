@@ -0,0 +1,200 @@
+// RadiusAcctSessions.cpp
+//
+// Table of accounting sessions, with octet counters and an interim update scheduler
+//
+// $Id: $
+
+#include "RadiusAcctSessions.h"
+
+RadiusAcctSessions::RadiusAcctSessions(uint16_t interval)
+{
+  uint16_t i;
+  for (i = 0; i < RADIUS_ACCT_MAX_SESSIONS; i++)
+    sessions[i].state = RadiusAcctSessionFree;
+  defaultInterval = interval;
+  next = 0;
+  count = 0;
+}
+
+uint16_t
+RadiusAcctSessions::hashId(const uint8_t* id, uint8_t length)
+{
+  // FNV-1a, folded to 16 bits
+  uint32_t h = 2166136261UL;
+  while (length--)
+  {
+    h ^= *id++;
+    h *= 16777619UL;
+  }
+  return (h >> 16) ^ (h & 0xffff);
+}
+
+RadiusAcctSession*
+RadiusAcctSessions::start(const uint8_t* id, uint8_t length, uint16_t interval)
+{
+  if (!length || length > RADIUS_ACCT_SESSION_ID_SIZE)
+    return 0;
+  uint16_t hash = hashId(id, length);
+
+  // Look for the session, and remember the first reusable entry on the way
+  RadiusAcctSession* free = 0;
+  uint16_t index = hash % RADIUS_ACCT_MAX_SESSIONS;
+  uint16_t i;
+  for (i = 0; i < RADIUS_ACCT_MAX_SESSIONS; i++)
+  {
+    RadiusAcctSession* s = &sessions[index];
+    if (s->state == RadiusAcctSessionFree)
+    {
+      if (!free)
+	free = s;
+      break; // Not in the table
+    }
+    if (s->state == RadiusAcctSessionDeleted)
+    {
+      if (!free)
+	free = s;
+    }
+    else if (s->hash == hash && s->idLength == length && memcmp(s->id, id, length) == 0)
+      return s; // Already started
+    if (++index >= RADIUS_ACCT_MAX_SESSIONS)
+      index = 0;
+  }
+  if (!free)
+    return 0; // Table full
+
+  memset(free, 0, sizeof(*free));
+  memcpy(free->id, id, length);
+  free->idLength = length;
+  free->hash = hash;
+  free->interval = interval ? interval : defaultInterval;
+  free->lastTime = RadiusMsg::now();
+  // Spread the updates of sessions that start together over the interval, by
+  // making the first one due after a part of the interval that depends on the hash
+  unsigned long period = 1000UL * free->interval;
+  unsigned long phase = (period >> 16) * hash + ((period & 0xffff) * hash >> 16);
+  free->nextInterim = free->lastTime + period - phase;
+  free->state = RadiusAcctSessionActive;
+  count++;
+  return free;
+}
+
+RadiusAcctSession*
+RadiusAcctSessions::find(const uint8_t* id, uint8_t length)
+{
+  uint16_t hash = hashId(id, length);
+  uint16_t index = hash % RADIUS_ACCT_MAX_SESSIONS;
+  uint16_t i;
+  for (i = 0; i < RADIUS_ACCT_MAX_SESSIONS; i++)
+  {
+    RadiusAcctSession* s = &sessions[index];
+    if (s->state == RadiusAcctSessionFree)
+      break;
+    if (   s->state == RadiusAcctSessionActive
+	&& s->hash == hash
+	&& s->idLength == length
+	&& memcmp(s->id, id, length) == 0)
+      return s;
+    if (++index >= RADIUS_ACCT_MAX_SESSIONS)
+      index = 0;
+  }
+  return 0;
+}
+
+void
+RadiusAcctSessions::stop(RadiusAcctSession* session)
+{
+  if (session->state != RadiusAcctSessionActive)
+    return;
+  uint16_t i;
+  if (--count == 0)
+  {
+    // Nothing left to find
+    for (i = 0; i < RADIUS_ACCT_MAX_SESSIONS; i++)
+      sessions[i].state = RadiusAcctSessionFree;
+    return;
+  }
+  // Later sessions with the same starting index may have been placed beyond this one,
+  // so it stays in the way of lookups. Unless the next entry is free: then no lookup
+  // goes past it, and it and any deleted entries just before it can be freed
+  uint16_t index = session - sessions;
+  uint16_t after = index + 1 < RADIUS_ACCT_MAX_SESSIONS ? index + 1 : 0;
+  if (sessions[after].state != RadiusAcctSessionFree)
+  {
+    session->state = RadiusAcctSessionDeleted;
+    return;
+  }
+  for (i = 0; i < RADIUS_ACCT_MAX_SESSIONS; i++)
+  {
+    sessions[index].state = RadiusAcctSessionFree;
+    index = index ? index - 1 : RADIUS_ACCT_MAX_SESSIONS - 1;
+    if (sessions[index].state != RadiusAcctSessionDeleted)
+      break;
+  }
+}
+
+void
+RadiusAcctSessions::updateTime(RadiusAcctSession* session)
+{
+  unsigned long seconds = (RadiusMsg::now() - session->lastTime) / 1000;
+  session->sessionTime += seconds;
+  session->lastTime += seconds * 1000;
+}
+
+void
+RadiusAcctSessions::addTraffic(RadiusAcctSession* session, uint32_t inputOctets, uint32_t outputOctets,
+                               uint32_t inputPackets, uint32_t outputPackets)
+{
+  // Carry into the Gigawords when the octet count wraps around
+  session->inputOctets += inputOctets;
+  if (session->inputOctets < inputOctets)
+    session->inputGigawords++;
+  session->outputOctets += outputOctets;
+  if (session->outputOctets < outputOctets)
+    session->outputGigawords++;
+  session->inputPackets += inputPackets;
+  session->outputPackets += outputPackets;
+}
+
+RadiusAcctSession*
+RadiusAcctSessions::due()
+{
+  unsigned long now = RadiusMsg::now();
+  uint16_t i;
+  for (i = 0; i < RADIUS_ACCT_MAX_SESSIONS; i++)
+  {
+    // Carry on from where the last call stopped, so every session gets its turn
+    RadiusAcctSession* s = &sessions[next];
+    if (++next >= RADIUS_ACCT_MAX_SESSIONS)
+      next = 0;
+    if (s->state != RadiusAcctSessionActive)
+      continue;
+    updateTime(s);
+    if (!s->interval || (long)(now - s->nextInterim) < 0)
+      continue;
+    unsigned long period = 1000UL * s->interval;
+    s->nextInterim += period;
+    if ((long)(now - s->nextInterim) >= 0)
+      s->nextInterim = now + period; // Fell far behind: dont send a burst to catch up
+    return s;
+  }
+  return 0;
+}
+
+void
+RadiusAcctSessions::addAttrs(RadiusMsg* msg, RadiusAcctSession* session, uint32_t statusType)
+{
+  msg->addAttr(RadiusAttrAcctStatusType, 0, statusType);
+  msg->addAttr(RadiusAttrAcctSessionId, 0, session->id, session->idLength);
+  if (statusType == RadiusValueAcctStatusTypeStart)
+    return;
+  updateTime(session);
+  msg->addAttr(RadiusAttrAcctSessionTime, 0, session->sessionTime);
+  msg->addAttr(RadiusAttrAcctInputOctets, 0, session->inputOctets);
+  msg->addAttr(RadiusAttrAcctOutputOctets, 0, session->outputOctets);
+  msg->addAttr(RadiusAttrAcctInputPackets, 0, session->inputPackets);
+  msg->addAttr(RadiusAttrAcctOutputPackets, 0, session->outputPackets);
+  if (session->inputGigawords)
+    msg->addAttr(RadiusAttrAcctInputGigawords, 0, session->inputGigawords);
+  if (session->outputGigawords)
+    msg->addAttr(RadiusAttrAcctOutputGigawords, 0, session->outputGigawords);
+}
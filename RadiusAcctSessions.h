@@ -0,0 +1,178 @@
+// RadiusAcctSessions.h
+//
+// Table of accounting sessions, with octet counters and an interim update scheduler
+//
+// $Id: $
+
+#ifndef _RADIUSACCTSESSIONS_H_
+#define _RADIUSACCTSESSIONS_H_
+
+#include "RadiusMsg.h"
+
+// Maximum number of sessions in the table. A few more than the number of sessions
+// expected at once keeps lookups short
+#ifndef RADIUS_ACCT_MAX_SESSIONS
+#define RADIUS_ACCT_MAX_SESSIONS 16
+#endif
+#if RADIUS_ACCT_MAX_SESSIONS > 65535
+#error RADIUS_ACCT_MAX_SESSIONS must be no more than 65535
+#endif
+// Maximum length of an Acct-Session-Id, in octets
+#ifndef RADIUS_ACCT_SESSION_ID_SIZE
+#define RADIUS_ACCT_SESSION_ID_SIZE 16
+#endif
+// Default Acct-Interim-Interval, in seconds
+#define RADIUS_ACCT_DEFAULT_INTERIM 600
+
+// State of an entry in a RadiusAcctSessions table
+typedef enum
+{
+    RadiusAcctSessionFree = 0,
+    RadiusAcctSessionActive,
+    RadiusAcctSessionDeleted,
+} RadiusAcctSessionState;
+
+/////////////////////////////////////////////////////////////////////
+/// \struct RadiusAcctSession
+/// An accounting session, and the traffic counted for it. The 64 bit octet counts are
+/// kept as the Acct-Input-Octets and Acct-Input-Gigawords pairs that are sent in
+/// accounting requests
+typedef struct
+{
+    /// Octets received from the user, modulo 2^32
+    uint32_t      inputOctets;
+
+    /// Number of times inputOctets has wrapped around
+    uint32_t      inputGigawords;
+
+    /// Octets sent to the user, modulo 2^32
+    uint32_t      outputOctets;
+
+    /// Number of times outputOctets has wrapped around
+    uint32_t      outputGigawords;
+
+    /// Packets received from the user
+    uint32_t      inputPackets;
+
+    /// Packets sent to the user
+    uint32_t      outputPackets;
+
+    /// Seconds since the session started, up to lastTime
+    uint32_t      sessionTime;
+
+    /// RadiusMsg::now() up to which sessionTime has been counted
+    unsigned long lastTime;
+
+    /// RadiusMsg::now() when the next interim update is due
+    unsigned long nextInterim;
+
+    /// Time between interim updates, in seconds, or 0 for none
+    uint16_t      interval;
+
+    /// Hash of the Acct-Session-Id
+    uint16_t      hash;
+
+    /// Length of the Acct-Session-Id
+    uint8_t       idLength;
+
+    /// One of RadiusAcctSessionState
+    uint8_t       state;
+
+    /// The Acct-Session-Id
+    uint8_t       id[RADIUS_ACCT_SESSION_ID_SIZE];
+
+} RadiusAcctSession;
+
+/////////////////////////////////////////////////////////////////////
+/// \class RadiusAcctSessions RadiusAcctSessions.h <RadiusAcctSessions.h>
+/// \brief Class to keep track of accounting sessions, and when to send their interim updates
+///
+/// For a NAS: keeps the traffic counters of up to RADIUS_ACCT_MAX_SESSIONS sessions, looked up
+/// by Acct-Session-Id, and schedules their Accounting Interim-Update requests
+/// (Acct-Status-Type Alive).
+///
+/// The sessions are kept in a fixed open addressing hash table, with linear probing, so
+/// nothing is allocated and lookups take a few comparisons when the table is not too full.
+/// The fields that change with traffic come first in each RadiusAcctSession, so counting
+/// touches the fewest cache lines on processors that have them.
+///
+/// addTraffic() adds to the counters of a session, carrying octet counts that pass 2^32 into
+/// the Acct-Input-Gigawords and Acct-Output-Gigawords counts (RFC 2869).
+///
+/// Interim updates are spread out, so sessions that start together, such as after a power
+/// failure, dont all send their updates together: the first update of each session is due
+/// after a part of its interval that depends on its Acct-Session-Id, and later updates every
+/// interval after that. due() returns one session at a time, so a loop() that sends
+/// one request per call paces the updates.
+///
+/// Build the accounting requests with addAttrs(), which adds the Acct-Status-Type,
+/// Acct-Session-Id and, except for Start, the counters and Acct-Session-Time. Times come
+/// from RadiusMsg::now(). The session time is kept in seconds, brought up to date by due() and
+/// addAttrs(), so it does not wrap around with the millisecond clock after 49.7 days.
+class RadiusAcctSessions
+{
+private:
+    /// The hash table
+    RadiusAcctSession sessions[RADIUS_ACCT_MAX_SESSIONS];
+
+    /// Default time between interim updates, in seconds
+    uint16_t          defaultInterval;
+
+    /// Where due() looks first
+    uint16_t          next;
+
+    /// Hash an Acct-Session-Id
+    static uint16_t   hashId(const uint8_t* id, uint8_t length);
+
+    /// Count the whole seconds since the session time was last updated
+    static void       updateTime(RadiusAcctSession* session);
+
+public:
+    /// Number of sessions active
+    uint16_t          count;
+
+    /// Constructor
+    /// \param[in] interval Default time between interim updates, in seconds, or 0 for none
+    RadiusAcctSessions(uint16_t interval = RADIUS_ACCT_DEFAULT_INTERIM);
+
+    /// Start a new session, with all its counters 0. Send an Accounting Start for it
+    /// \param[in] id The Acct-Session-Id
+    /// \param[in] length Length of id in octets, up to RADIUS_ACCT_SESSION_ID_SIZE
+    /// \param[in] interval Time between interim updates, in seconds, such as the
+    /// Acct-Interim-Interval from the Access-Accept, or 0 for the default
+    /// \return The session, or 0 if the table is full or id is too long. If the session has
+    /// already been started, it is returned unchanged
+    RadiusAcctSession* start(const uint8_t* id, uint8_t length, uint16_t interval = 0);
+
+    /// Find an active session
+    /// \param[in] id The Acct-Session-Id
+    /// \param[in] length Length of id in octets
+    /// \return The session, or 0 if there is none
+    RadiusAcctSession* find(const uint8_t* id, uint8_t length);
+
+    /// Remove a session from the table, after sending its Accounting Stop
+    /// \param[in] session The session
+    void               stop(RadiusAcctSession* session);
+
+    /// Count traffic for a session
+    /// \param[in] session The session
+    /// \param[in] inputOctets Octets received from the user
+    /// \param[in] outputOctets Octets sent to the user
+    /// \param[in] inputPackets Packets received from the user
+    /// \param[in] outputPackets Packets sent to the user
+    static void        addTraffic(RadiusAcctSession* session, uint32_t inputOctets, uint32_t outputOctets,
+                                  uint32_t inputPackets = 0, uint32_t outputPackets = 0);
+
+    /// Get a session whose interim update is due, and schedule its next one.
+    /// Call regularly, such as once per loop(), and send an Interim-Update for each session returned
+    /// \return A session, or 0 if none is due
+    RadiusAcctSession* due();
+
+    /// Add the accounting attributes of a session to an Accounting-Request
+    /// \param[in] msg The Accounting-Request
+    /// \param[in] session The session
+    /// \param[in] statusType The Acct-Status-Type, such as RadiusValueAcctStatusTypeAlive
+    static void        addAttrs(RadiusMsg* msg, RadiusAcctSession* session, uint32_t statusType);
+};
+
+#endif
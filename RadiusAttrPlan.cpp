@@ -0,0 +1,125 @@
+// RadiusAttrPlan.cpp
+//
+// Extracts several attributes from a RadiusMsg in a single pass
+//
+// $Id: $
+
+#include "RadiusAttrPlan.h"
+
+// Hash of an attribute and vendor number into the lookup table
+#define RADIUS_PLAN_HASH(type, vendor) (((type) ^ ((vendor) * 7)) & (RADIUS_PLAN_TABLE_SIZE - 1))
+
+RadiusAttrPlan::RadiusAttrPlan()
+{
+  numKeys = 0;
+  hasVendorKeys = false;
+  memset(table, 0, sizeof(table));
+  memset(views, 0, sizeof(views));
+}
+
+uint8_t
+RadiusAttrPlan::lookup(uint8_t type, uint32_t vendor)
+{
+  // Linear probing. The table is never more than half full, so there is always an empty entry
+  uint8_t i = RADIUS_PLAN_HASH(type, vendor);
+  while (table[i])
+  {
+    uint8_t slot = table[i] - 1;
+    if (types[slot] == type && vendors[slot] == vendor)
+      return slot;
+    i = (i + 1) & (RADIUS_PLAN_TABLE_SIZE - 1);
+  }
+  return RADIUS_PLAN_NO_SLOT;
+}
+
+uint8_t
+RadiusAttrPlan::add(unsigned type, unsigned vendor)
+{
+  uint8_t slot = lookup(type, vendor);
+  if (slot != RADIUS_PLAN_NO_SLOT)
+    return slot; // Already wanted
+  if (numKeys >= RADIUS_PLAN_MAX_KEYS)
+    return RADIUS_PLAN_NO_SLOT; // Full
+
+  slot = numKeys++;
+  types[slot] = type;
+  vendors[slot] = vendor;
+  if (vendor)
+    hasVendorKeys = true;
+
+  uint8_t i = RADIUS_PLAN_HASH(type, vendor);
+  while (table[i])
+    i = (i + 1) & (RADIUS_PLAN_TABLE_SIZE - 1);
+  table[i] = slot + 1;
+  return slot;
+}
+
+void
+RadiusAttrPlan::record(uint8_t type, uint32_t vendor, const RadiusAttrHeader* h)
+{
+  uint8_t slot = lookup(type, vendor);
+  if (slot != RADIUS_PLAN_NO_SLOT && !views[slot].value)
+  {
+    views[slot].value = h->value;
+    views[slot].length = h->length - 2;
+  }
+}
+
+uint8_t
+RadiusAttrPlan::extract(RadiusMsg* msg)
+{
+  memset(views, 0, sizeof(views));
+
+  uint8_t* p = (uint8_t*)&msg->packet;
+  uint16_t i;
+  for (i = RADIUS_HEADER_LENGTH; i + 2 <= msg->packetLength;)
+  {
+    const RadiusAttrHeader* h = (const RadiusAttrHeader*)(p + i);
+    if (h->length < 2 || i + h->length > msg->packetLength)
+      break; // Malformed
+
+    record(h->type, 0, h);
+    if (h->type == RadiusAttrVendorSpecific && hasVendorKeys && h->length >= 8)
+    {
+      // Look in the sub attributes of this VSA
+      uint32_t vendor = (uint32_t)h->value[0] << 24 | (uint32_t)h->value[1] << 16 
+                      | (uint32_t)h->value[2] << 8 | h->value[3];
+      uint8_t j;
+      for (j = 6; j + 2 <= h->length;)
+      {
+        const RadiusAttrHeader* v = (const RadiusAttrHeader*)((uint8_t*)h + j);
+        if (v->length < 2 || j + v->length > h->length)
+          break; // Malformed
+        record(v->type, vendor, v);
+        j += v->length;
+      }
+    }
+    i += h->length;
+  }
+
+  uint8_t found = 0;
+  for (i = 0; i < numKeys; i++)
+    if (views[i].value)
+      found++;
+  return found;
+}
+
+uint8_t
+RadiusAttrPlan::get(uint8_t slot, RadiusAttrView* view)
+{
+  if (slot >= numKeys || !views[slot].value)
+    return false;
+  *view = views[slot];
+  return true;
+}
+
+uint8_t
+RadiusAttrPlan::get(uint8_t slot, uint32_t* value)
+{
+  RadiusAttrView view;
+  if (!get(slot, &view) || view.length != 4)
+    return false;
+  *value = (uint32_t)view.value[0] << 24 | (uint32_t)view.value[1] << 16 
+         | (uint32_t)view.value[2] << 8 | view.value[3];
+  return true;
+}
@@ -0,0 +1,91 @@
+// RadiusAttrPlan.h
+//
+// Extracts several attributes from a RadiusMsg in a single pass
+//
+// $Id: $
+
+#ifndef _RADIUSATTRPLAN_H_
+#define _RADIUSATTRPLAN_H_
+
+#include "RadiusMsg.h"
+
+// Maximum number of attributes that can be requested from one plan
+#define RADIUS_PLAN_MAX_KEYS 16
+// Size of the lookup table. Must be a power of 2, and larger than RADIUS_PLAN_MAX_KEYS
+#define RADIUS_PLAN_TABLE_SIZE 32
+// Returned by RadiusAttrPlan::add() when the plan is full
+#define RADIUS_PLAN_NO_SLOT 0xff
+
+/////////////////////////////////////////////////////////////////////
+/// \class RadiusAttrPlan RadiusAttrPlan.h <RadiusAttrPlan.h>
+/// \brief Class to get a number of attributes from a RADIUS message in one pass
+///
+/// Calling RadiusMsg::getAttr() for each wanted attribute scans the whole message every time.
+/// A RadiusAttrPlan is built once with the list of wanted attributes, and can then be used
+/// to extract all of them from each received message with a single scan. Each attribute 
+/// in the message is looked up in a small hash table, so the cost of extract() does not 
+/// depend on the number of wanted attributes. 
+/// The values are not copied: each slot refers to the value inside the message,
+/// and is only valid until the message is changed.
+/// Only the first occurrence of each wanted attribute is recorded. Use RadiusMsg::getAttr()
+/// with skip to get later occurrences.
+class RadiusAttrPlan
+{
+private:
+    /// Attribute numbers of the wanted attributes, indexed by slot
+    uint8_t        types[RADIUS_PLAN_MAX_KEYS];
+
+    /// Vendor numbers of the wanted attributes, indexed by slot
+    uint32_t       vendors[RADIUS_PLAN_MAX_KEYS];
+
+    /// Result of the last extract(), indexed by slot. length 0 and value 0 means not found
+    RadiusAttrView views[RADIUS_PLAN_MAX_KEYS];
+
+    /// Hash table of slot numbers + 1, indexed by hash of attribute and vendor numbers. 
+    /// 0 means empty
+    uint8_t        table[RADIUS_PLAN_TABLE_SIZE];
+
+    /// Number of slots in use
+    uint8_t        numKeys;
+
+    /// true if any of the wanted attributes are VSAs
+    uint8_t        hasVendorKeys;
+
+    /// Find the slot for an attribute
+    /// \return the slot number, or RADIUS_PLAN_NO_SLOT if the attribute is not wanted
+    uint8_t        lookup(uint8_t type, uint32_t vendor);
+
+    /// Record the value of an attribute, if it is wanted and not already found
+    void           record(uint8_t type, uint32_t vendor, const RadiusAttrHeader* h);
+
+public:
+    /// Constructor. The plan is initially empty
+    RadiusAttrPlan();
+
+    /// Add a wanted attribute to the plan.
+    /// \param[in] type The RADIUS attribute number
+    /// \param[in] vendor The vendor number of the attribute, 0 for standard attributes
+    /// \return The slot number to use with get() to get the value after extract(), 
+    /// or RADIUS_PLAN_NO_SLOT if the plan is full.
+    /// Adding the same attribute twice returns the same slot
+    uint8_t        add(unsigned type, unsigned vendor);
+
+    /// Scan the message once, and record the first occurrence of each wanted attribute.
+    /// \param[in] msg The message to extract from
+    /// \return The number of wanted attributes that were found
+    uint8_t        extract(RadiusMsg* msg);
+
+    /// Get the value recorded in a slot by the last extract()
+    /// \param[in] slot The slot number, as returned by add()
+    /// \param[out] view Set to refer to the value in the message
+    /// \return true if the attribute was found
+    uint8_t        get(uint8_t slot, RadiusAttrView* view);
+
+    /// Get the value recorded in a slot by the last extract() as a 32 bit unsigned integer
+    /// \param[in] slot The slot number, as returned by add()
+    /// \param[out] value Destination to copy the value to
+    /// \return true if the attribute was found and is a valid integer
+    uint8_t        get(uint8_t slot, uint32_t* value);
+};
+
+#endif
@@ -0,0 +1,104 @@
+// RadiusCapture.h
+//
+// Captures sent and received RADIUS packets in pcap format
+//
+// $Id: $
+
+#ifndef _RADIUSCAPTURE_H_
+#define _RADIUSCAPTURE_H_
+
+#if ARDUINO >= 100
+#include <Arduino.h>
+#else
+#include <wiring.h>
+#endif
+#include <IPAddress.h>
+
+// Size of the buffer holding captured packets until they are drained. Must be a power of 2
+#define RADIUS_CAPTURE_BUFFER_SIZE 1024
+// Maximum number of RADIUS octets saved from each packet. Longer packets are truncated
+#define RADIUS_CAPTURE_SNAPLEN 256
+// Length of the synthesized IPv4 and UDP headers before each captured RADIUS packet
+#define RADIUS_CAPTURE_IP_UDP_LENGTH 28
+// Length of the pcap header before each captured packet
+#define RADIUS_CAPTURE_RECORD_HEADER_LENGTH 16
+// Length of the pcap header at the start of the file
+#define RADIUS_CAPTURE_FILE_HEADER_LENGTH 24
+// pcap link type for raw IPv4 packets
+#define RADIUS_CAPTURE_LINKTYPE_RAW 101
+
+/////////////////////////////////////////////////////////////////////
+/// \class RadiusCapture RadiusCapture.h <RadiusCapture.h>
+/// \brief Class to save sent and received RADIUS packets in a pcap file
+///
+/// When connected with RadiusMsg::setCapture(), every RADIUS packet sent by 
+/// RadiusMsg::sendto() and received by RadiusMsg::recv() is saved with synthesized IPv4 and 
+/// UDP headers and a timestamp, so that the capture can be read by tcpdump or Wireshark. 
+/// The output can be anything that supports Print, such as a File on an SD card, or Serial.
+///
+/// Capturing only copies the packet into a ring buffer, so it is cheap enough to leave enabled.
+/// The buffer is written to the output by drain(), which should be called regularly from loop(). 
+/// If the buffer is full, the packet is not saved and is counted in dropped().
+/// Timestamps are from RadiusMsg::now(), so they are relative to when the board was started,
+/// or are in virtual time with a simulated clock.
+class RadiusCapture
+{
+private:
+    /// Where the pcap file is written
+    Print*    out;
+
+    /// Address of this host, used in the synthesized IP headers
+    IPAddress localAddress;
+
+    /// Port number of the local UDP socket, used in the synthesized UDP headers
+    uint16_t  localPort;
+
+    /// Captured records waiting to be written to out
+    uint8_t   ring[RADIUS_CAPTURE_BUFFER_SIZE];
+
+    /// Free running index of the next octet to add to ring
+    uint16_t  head;
+
+    /// Free running index of the next octet to write to out
+    uint16_t  tail;
+
+    /// Number of packets not captured because the buffer was full
+    uint32_t  droppedPackets;
+
+    /// Add octets to the ring. Caller must have checked there is room
+    void      put(const uint8_t* data, uint16_t length);
+
+    /// Add a 16 bit integer to the ring in network byte order
+    void      put16(uint16_t value);
+
+    /// Add a 32 bit integer to the ring in little endian byte order, as used by pcap headers
+    void      put32le(uint32_t value);
+
+public:
+    /// Constructor
+    /// \param[in] out Where to write the pcap file
+    /// \param[in] localAddress The IP address of this host
+    /// \param[in] localPort The port number of the local UDP socket used for RADIUS
+    RadiusCapture(Print* out, IPAddress localAddress, uint16_t localPort);
+
+    /// Write the pcap file header to the output. Call once before any packets are captured
+    void      begin();
+
+    /// Save a packet in the buffer
+    /// \param[in] data The RADIUS packet
+    /// \param[in] length Number of octets in the RADIUS packet
+    /// \param[in] peerAddress IP address of the peer
+    /// \param[in] peerPort UDP port number of the peer
+    /// \param[in] sent true if the packet was sent to the peer, false if it was received from the peer
+    void      capture(const uint8_t* data, uint16_t length, IPAddress peerAddress, uint16_t peerPort, uint8_t sent);
+
+    /// Write all the captured packets in the buffer to the output
+    /// \return The number of octets written
+    uint16_t  drain();
+
+    /// Return the number of packets that were not captured because the buffer was full
+    /// \return Number of dropped packets
+    uint32_t  dropped();
+};
+
+#endif
@@ -0,0 +1,306 @@
+// RadiusMetricsServer.cpp
+//
+// Minimal HTTP server exporting RadiusStats and RadiusServer queues in Prometheus text format
+//
+// $Id: $
+
+#include "RadiusMetricsServer.h"
+#include "RadiusMsg.h"
+
+RadiusMetricsBuffer::RadiusMetricsBuffer()
+{
+  out = 0;
+  length = 0;
+}
+
+void
+RadiusMetricsBuffer::begin(Print* o)
+{
+  out = o;
+  length = 0;
+}
+
+void
+RadiusMetricsBuffer::send()
+{
+  if (length && out)
+    out->write(buffer, length);
+  length = 0;
+}
+
+size_t
+RadiusMetricsBuffer::write(uint8_t c)
+{
+  return write(&c, 1);
+}
+
+size_t
+RadiusMetricsBuffer::write(const uint8_t* data, size_t size)
+{
+  size_t written = size;
+  while (size)
+  {
+    if (length == RADIUS_METRICS_BUFFER_SIZE)
+      send();
+    size_t n = RADIUS_METRICS_BUFFER_SIZE - length;
+    if (n > size)
+      n = size;
+    memcpy(buffer + length, data, n);
+    length += n;
+    data += n;
+    size -= n;
+  }
+  return written;
+}
+
+RadiusMetricsServer::RadiusMetricsServer(uint16_t port)
+  : server(port)
+{
+  numStats = 0;
+  numServers = 0;
+  state = RadiusMetricsIdle;
+}
+
+void
+RadiusMetricsServer::begin()
+{
+  server.begin();
+}
+
+uint8_t
+RadiusMetricsServer::addStats(RadiusStats* s, const char* name)
+{
+  if (numStats >= RADIUS_METRICS_MAX_SERVERS)
+    return false;
+  stats[numStats] = s;
+  names[numStats] = name;
+  numStats++;
+  return true;
+}
+
+uint8_t
+RadiusMetricsServer::addServer(RadiusServer* s, const char* name)
+{
+  if (numServers >= RADIUS_METRICS_MAX_SERVERS)
+    return false;
+  radiusServers[numServers] = s;
+  serverNames[numServers] = name;
+  numServers++;
+  return true;
+}
+
+void
+RadiusMetricsServer::printCounter(Print* out, const char* name, const char* help, 
+                                  uint32_t RadiusStats::* counter)
+{
+  out->print("# HELP ");
+  out->print(name);
+  out->print(" ");
+  out->println(help);
+  out->print("# TYPE ");
+  out->print(name);
+  out->println(" counter");
+  uint8_t i;
+  for (i = 0; i < numStats; i++)
+  {
+    out->print(name);
+    out->print("{server=\"");
+    out->print(names[i]);
+    out->print("\"} ");
+    out->println((unsigned long)(stats[i]->*counter));
+  }
+}
+
+void
+RadiusMetricsServer::printGaugeHeader(Print* out, const char* name, const char* help)
+{
+  out->print("# HELP ");
+  out->print(name);
+  out->print(" ");
+  out->println(help);
+  out->print("# TYPE ");
+  out->print(name);
+  out->println(" gauge");
+}
+
+void
+RadiusMetricsServer::printGauge(Print* out, const char* name, uint8_t index, unsigned long value)
+{
+  out->print(name);
+  out->print("{server=\"");
+  out->print(serverNames[index]);
+  out->print("\"} ");
+  out->println(value);
+}
+
+void
+RadiusMetricsServer::printMetrics(Print* out)
+{
+  uint8_t section = 0;
+  while (printSection(out, section))
+    section++;
+}
+
+uint8_t
+RadiusMetricsServer::printSection(Print* out, uint8_t section)
+{
+  uint8_t i, j;
+
+  switch (section)
+  {
+  case 0:
+    out->println("# HELP radius_client_requests_total RADIUS requests sent, not counting retransmissions");
+    out->println("# TYPE radius_client_requests_total counter");
+    for (i = 0; i < numStats; i++)
+    {
+      for (j = 0; j < RADIUS_STATS_CODES; j++)
+      {
+	if (!stats[i]->requestsByCode[j])
+	  continue;
+	out->print("radius_client_requests_total{server=\"");
+	out->print(names[i]);
+	out->print("\",code=\"");
+	out->print(j);
+	out->print("\"} ");
+	out->println((unsigned long)stats[i]->requestsByCode[j]);
+      }
+    }
+    return true;
+
+  case 1:
+    printCounter(out, "radius_client_replies_total", "Matching RADIUS replies received",
+		 &RadiusStats::replies);
+    return true;
+
+  case 2:
+    printCounter(out, "radius_client_retransmits_total", "RADIUS request retransmissions",
+		 &RadiusStats::retransmits);
+    return true;
+
+  case 3:
+    printCounter(out, "radius_client_timeouts_total", "RADIUS requests with no reply after all retries",
+		 &RadiusStats::timeouts);
+    return true;
+
+  case 4:
+    printCounter(out, "radius_client_bad_authenticators_total", "RADIUS replies with an incorrect authenticator",
+		 &RadiusStats::badAuthenticators);
+    return true;
+
+  case 5:
+    printCounter(out, "radius_client_discarded_total", "Received packets discarded while waiting for a reply",
+		 &RadiusStats::discarded);
+    return true;
+
+  case 6:
+    out->println("# HELP radius_client_latency_milliseconds Time from first transmission of a request to its reply");
+    out->println("# TYPE radius_client_latency_milliseconds histogram");
+    for (i = 0; i < numStats; i++)
+    {
+      uint32_t count = 0;
+      for (j = 0; j < RADIUS_STATS_BUCKETS; j++)
+      {
+	count += stats[i]->latency[j];
+	out->print("radius_client_latency_milliseconds_bucket{server=\"");
+	out->print(names[i]);
+	out->print("\",le=\"");
+	if (j == RADIUS_STATS_BUCKETS - 1)
+	  out->print("+Inf");
+	else
+	  out->print(RadiusStats::bucketLatency(j + 1) - 1); // Latencies are whole milliseconds
+	out->print("\"} ");
+	out->println((unsigned long)count);
+      }
+      out->print("radius_client_latency_milliseconds_sum{server=\"");
+      out->print(names[i]);
+      out->print("\"} ");
+      out->println((unsigned long)stats[i]->latencySum);
+      out->print("radius_client_latency_milliseconds_count{server=\"");
+      out->print(names[i]);
+      out->print("\"} ");
+      out->println((unsigned long)count);
+    }
+    return true;
+
+  case 7:
+    if (!numServers)
+      return true;
+    printGaugeHeader(out, "radius_server_queue_depth", "RADIUS requests queued or being handled");
+    for (i = 0; i < numServers; i++)
+      printGauge(out, "radius_server_queue_depth", i, radiusServers[i]->depth());
+    printGaugeHeader(out, "radius_server_queue_free", "Free RADIUS request queue slots");
+    for (i = 0; i < numServers; i++)
+      printGauge(out, "radius_server_queue_free", i, 
+		 RADIUS_SERVER_QUEUE_SIZE - radiusServers[i]->depth());
+    printGaugeHeader(out, "radius_server_queue_max_depth", "The most RADIUS request queue slots ever in use at once");
+    for (i = 0; i < numServers; i++)
+      printGauge(out, "radius_server_queue_max_depth", i, radiusServers[i]->maxDepth);
+    return true;
+  }
+  return false;
+}
+
+uint8_t
+RadiusMetricsServer::poll()
+{
+  switch (state)
+  {
+  case RadiusMetricsIdle:
+    client = server.available();
+    if (!client)
+      return false;
+    newlines = 0;
+    acceptTime = RadiusMsg::now();
+    state = RadiusMetricsReading;
+    return true;
+
+  case RadiusMetricsReading:
+    {
+      // Read and ignore what has arrived of the request, up to the blank line at the end 
+      // of the headers
+      if (!client.connected())
+	break;
+      uint8_t data[32];
+      int n = client.available();
+      if (n > (int)sizeof(data))
+	n = sizeof(data);
+      if (n > 0)
+	n = client.read(data, n);
+      int i;
+      for (i = 0; i < n && newlines < 2; i++)
+      {
+	if (data[i] == '\n')
+	  newlines++;
+	else if (data[i] != '\r')
+	  newlines = 0;
+      }
+      // A scraper that is too slow gets its answer anyway
+      if (newlines < 2 && RadiusMsg::now() - acceptTime < RADIUS_METRICS_REQUEST_TIMEOUT)
+	return true;
+      buffer.begin(&client);
+      buffer.println("HTTP/1.1 200 OK");
+      buffer.println("Content-Type: text/plain; version=0.0.4");
+      buffer.println("Connection: close");
+      buffer.println();
+      section = 0;
+      state = RadiusMetricsWriting;
+      return true;
+    }
+
+  case RadiusMetricsWriting:
+    if (!client.connected())
+      break;
+    if (printSection(&buffer, section))
+    {
+      section++;
+      return true;
+    }
+    buffer.send();
+    break;
+  }
+
+  // Finished with this connection
+  client.stop();
+  state = RadiusMetricsIdle;
+  return false;
+}
@@ -0,0 +1,185 @@
+// RadiusMetricsServer.h
+//
+// Minimal HTTP server exporting RadiusStats and RadiusServer queues in Prometheus text format
+//
+// $Id: $
+
+#ifndef _RADIUSMETRICSSERVER_H_
+#define _RADIUSMETRICSSERVER_H_
+
+#include <Ethernet.h>
+#include "RadiusStats.h"
+#include "RadiusServer.h"
+
+// Maximum number of RadiusStats that can be exported, and of RadiusServers
+#define RADIUS_METRICS_MAX_SERVERS 4
+// How long to wait for a scraper to send its HTTP request, in milliseconds
+#define RADIUS_METRICS_REQUEST_TIMEOUT 1000
+// Size of the buffer the response is rendered into, and so of the chunks written to the connection
+#ifndef RADIUS_METRICS_BUFFER_SIZE
+#define RADIUS_METRICS_BUFFER_SIZE 256
+#endif
+
+// State of the connection being served by a RadiusMetricsServer
+typedef enum
+{
+    RadiusMetricsIdle = 0,
+    RadiusMetricsReading,
+    RadiusMetricsWriting,
+} RadiusMetricsState;
+
+/////////////////////////////////////////////////////////////////////
+/// \class RadiusMetricsBuffer RadiusMetricsServer.h <RadiusMetricsServer.h>
+/// \brief Print that collects its output into a buffer, and writes it to another Print
+/// RADIUS_METRICS_BUFFER_SIZE octets at a time.
+///
+/// Writing a TCP connection one number or label at a time costs a bus transfer, and on some
+/// Ethernet libraries a packet, for each print(). 
+class RadiusMetricsBuffer : public Print
+{
+private:
+    /// Where the output goes
+    Print*   out;
+
+    /// The output not yet written
+    uint8_t  buffer[RADIUS_METRICS_BUFFER_SIZE];
+
+    /// Number of octets in buffer
+    uint16_t length;
+
+public:
+    /// Constructor
+    RadiusMetricsBuffer();
+
+    /// Set where the output goes, discarding anything not yet written
+    /// \param[in] out Where to write the output
+    void     begin(Print* out);
+
+    /// Write anything in the buffer
+    void     send();
+
+    /// Add an octet to the buffer, writing the buffer first if it is full
+    virtual size_t write(uint8_t c);
+
+    /// Add octets to the buffer, writing the buffer whenever it is full
+    virtual size_t write(const uint8_t* data, size_t size);
+    using Print::write;
+};
+
+/////////////////////////////////////////////////////////////////////
+/// \class RadiusMetricsServer RadiusMetricsServer.h <RadiusMetricsServer.h>
+/// \brief Class to export RadiusStats to a Prometheus server over HTTP
+///
+/// Listens for HTTP connections on a TCP port, and answers every request with the 
+/// counters and latency histograms of each added RadiusStats, in Prometheus text format.
+/// Each RadiusStats is labelled with the name of its RADIUS server. The queues of any added
+/// RadiusServers are exported as gauges, labelled with the name they were added with.
+/// There are no threads: call poll() from loop(). Each call takes one step in serving a
+/// scraper, reading what has arrived of its request or writing one group of metrics, so loop()
+/// is never held up waiting for the scraper. The response is rendered into a RadiusMetricsBuffer,
+/// and written in chunks of RADIUS_METRICS_BUFFER_SIZE octets.
+/// The counters are read as they are, without stopping the sending of RADIUS requests.
+/// 
+/// The exported metrics are:
+/// \li radius_client_requests_total, by code
+/// \li radius_client_replies_total
+/// \li radius_client_retransmits_total
+/// \li radius_client_timeouts_total
+/// \li radius_client_bad_authenticators_total
+/// \li radius_client_discarded_total
+/// \li radius_client_latency_milliseconds histogram
+/// \li radius_server_queue_depth, the requests queued or being handled
+/// \li radius_server_queue_free, the free queue slots
+/// \li radius_server_queue_max_depth, the most slots ever in use
+class RadiusMetricsServer
+{
+private:
+    /// The listening TCP server
+    EthernetServer server;
+
+    /// The exported statistics
+    RadiusStats*   stats[RADIUS_METRICS_MAX_SERVERS];
+
+    /// The RADIUS server name label for each exported RadiusStats
+    const char*    names[RADIUS_METRICS_MAX_SERVERS];
+
+    /// Number of exported RadiusStats
+    uint8_t        numStats;
+
+    /// The RadiusServers whose queues are exported
+    RadiusServer*  radiusServers[RADIUS_METRICS_MAX_SERVERS];
+
+    /// The server label for each exported RadiusServer
+    const char*    serverNames[RADIUS_METRICS_MAX_SERVERS];
+
+    /// Number of exported RadiusServers
+    uint8_t        numServers;
+
+    /// The connection being served
+    EthernetClient client;
+
+    /// One of RadiusMetricsState
+    uint8_t        state;
+
+    /// Number of line ends seen at the end of the request so far
+    uint8_t        newlines;
+
+    /// The next group of metrics to write
+    uint8_t        section;
+
+    /// RadiusMsg::now() when the connection was accepted
+    unsigned long  acceptTime;
+
+    /// The response being written
+    RadiusMetricsBuffer buffer;
+
+    /// Print one counter for all the exported RadiusStats
+    void           printCounter(Print* out, const char* name, const char* help, 
+                                uint32_t RadiusStats::* counter);
+
+    /// Print the HELP and TYPE lines of a gauge
+    void           printGaugeHeader(Print* out, const char* name, const char* help);
+
+    /// Print one sample of a gauge for an exported RadiusServer
+    void           printGauge(Print* out, const char* name, uint8_t index, unsigned long value);
+
+    /// Print one group of metrics
+    /// \param[in] out Where to print the metrics
+    /// \param[in] section Which group to print, starting at 0
+    /// \return true if printed, false if there are no more groups
+    uint8_t        printSection(Print* out, uint8_t section);
+
+public:
+    /// Constructor
+    /// \param[in] port The TCP port to listen on. Prometheus exporters conventionally use 9100 and up
+    RadiusMetricsServer(uint16_t port);
+
+    /// Start listening for connections. Call after Ethernet.begin()
+    void           begin();
+
+    /// Add a RadiusStats to be exported
+    /// \param[in] stats The statistics. Must remain valid while the server is used
+    /// \param[in] name The name of the RADIUS server the statistics are for, used as the
+    /// value of the server label. Must remain valid while the server is used
+    /// \return true if added, false if RADIUS_METRICS_MAX_SERVERS have already been added
+    uint8_t        addStats(RadiusStats* stats, const char* name);
+
+    /// Add a RadiusServer whose queue depth and free slots are to be exported
+    /// \param[in] server The server. Must remain valid while the metrics server is used
+    /// \param[in] name The value of the server label. Must remain valid while the 
+    /// metrics server is used
+    /// \return true if added, false if RADIUS_METRICS_MAX_SERVERS have already been added
+    uint8_t        addServer(RadiusServer* server, const char* name);
+
+    /// Print all the metrics in Prometheus text format
+    /// \param[in] out Where to print the metrics
+    void           printMetrics(Print* out);
+
+    /// Take the next step in serving a HTTP connection: accept a waiting connection, read 
+    /// what has arrived of its request, or write the next group of metrics. Does not wait.
+    /// Call regularly from loop()
+    /// \return true if a connection is being served
+    uint8_t        poll();
+};
+
+#endif
@@ -5,8 +5,10 @@
 // Author: Mike McCauley (mikem@airspayce.com)
 // $Id: RadiusMsg.cpp,v 1.1 2009/10/13 05:07:28 mikem Exp mikem $
 
-#include <Ethernet.h>
 #include "RadiusMsg.h"
+#ifdef __AVR__
+#include <avr/sleep.h>
+#endif
 //#include <string.h>
 
 extern "C" 
@@ -38,21 +40,248 @@ uint32_t htonl(uint32_t v)
 #define ntohl htonl
 
 static uint8_t nextIdentifier = 0;
+static uint8_t identifierInitialised = false;
+
+// Random numbers for authenticators and identifiers
+static RadiusRandom defaultRandom;
+static RadiusRandom* randomSource = &defaultRandom;
+
+// Allocate the identifier for a new request
+static uint8_t
+newIdentifier()
+{
+  // Start from a random identifier, so identifiers are not reused after a restart
+  if (!identifierInitialised)
+  {
+    nextIdentifier = randomSource->byte();
+    identifierInitialised = true;
+  }
+  return nextIdentifier++;
+}
+
+// Where sent and received packets are saved, if anywhere
+static RadiusCapture* capture = 0;
+
+// Called while waiting for a reply, if set
+static RadiusIdleFunction idleFunction = 0;
+
+// Clock for timeouts and latencies, if not millis()
+static RadiusClockFunction clockFunction = 0;
+
+// Prepare an MD5 context that has already hashed the shared secret. Every block of every
+// encrypted attribute in a packet starts with MD5(secret + ...), so the secret is hashed 
+// once per packet and the context copied for each block
+static void
+secretContext(md5_ctx* context, const char* secret, uint8_t secretLength)
+{
+  md5_init(context);
+  md5_update(context, (uint8_t*)secret, secretLength);
+}
+
+// XOR a block of RADIUS_PASSWORD_BLOCK_SIZE(16) octets with a digest, a word at a time. 
+// The data need not be aligned: memcpy of a word compiles to a load or store where that is allowed
+static void
+xorBlock(uint8_t* data, const uint32_t* digest)
+{
+  uint8_t j;
+  for (j = 0; j < RADIUS_PASSWORD_BLOCK_SIZE / sizeof(uint32_t); j++)
+  {
+    uint32_t w;
+    memcpy(&w, data + j * sizeof(uint32_t), sizeof(w));
+    w ^= digest[j];
+    memcpy(data + j * sizeof(uint32_t), &w, sizeof(w));
+  }
+}
+
+// RFC 2865 style encryption in place, with optional 2 octet salt (RFC 2868, RFC 2548)
+// b1 = MD5(S + iv [+ salt]), c1 = p1 ^ b1, bn = MD5(S + c(n-1)), cn = pn ^ bn
+static void
+encryptBlocks(uint8_t* data, uint8_t length, const md5_ctx* secret, const uint8_t* iv, const uint8_t* salt)
+{
+  uint8_t i;
+  for (i = 0; i < length; i += RADIUS_PASSWORD_BLOCK_SIZE)
+  {
+    md5_ctx context = *secret;
+    if (i == 0)
+    {
+      md5_update(&context, (uint8_t*)iv, RADIUS_AUTHENTICATOR_LENGTH);
+      if (salt)
+	md5_update(&context, (uint8_t*)salt, 2);
+    }
+    else
+      md5_update(&context, data + i - RADIUS_PASSWORD_BLOCK_SIZE, RADIUS_PASSWORD_BLOCK_SIZE);
+    uint32_t digest[RADIUS_PASSWORD_BLOCK_SIZE / sizeof(uint32_t)];
+    md5_final((uint8_t*)digest, &context);
+    xorBlock(data + i, digest);
+  }
+}
+
+// Reverse of encryptBlocks. Works from the last block back to the first, so the previous
+// ciphertext block each one depends on is still intact and no copy is needed
+static void
+decryptBlocks(uint8_t* data, uint8_t length, const md5_ctx* secret, const uint8_t* iv, const uint8_t* salt)
+{
+  uint8_t i = length & ~(RADIUS_PASSWORD_BLOCK_SIZE - 1);
+  while (i)
+  {
+    i -= RADIUS_PASSWORD_BLOCK_SIZE;
+    md5_ctx context = *secret;
+    if (i == 0)
+    {
+      md5_update(&context, (uint8_t*)iv, RADIUS_AUTHENTICATOR_LENGTH);
+      if (salt)
+	md5_update(&context, (uint8_t*)salt, 2);
+    }
+    else
+      md5_update(&context, data + i - RADIUS_PASSWORD_BLOCK_SIZE, RADIUS_PASSWORD_BLOCK_SIZE);
+    uint32_t digest[RADIUS_PASSWORD_BLOCK_SIZE / sizeof(uint32_t)];
+    md5_final((uint8_t*)digest, &context);
+    xorBlock(data + i, digest);
+  }
+}
+
+// Encrypt or decrypt the value of a salted attribute: 2 octets of salt, then the encrypted
+// length octet, data and padding
+static void
+cryptSalted(uint8_t* value, uint8_t length, const md5_ctx* secret, const uint8_t* iv, uint16_t* salt, uint8_t decrypt)
+{
+  if (length < 2 + RADIUS_PASSWORD_BLOCK_SIZE || (length - 2) % RADIUS_PASSWORD_BLOCK_SIZE)
+    return; // Malformed
+  if (decrypt)
+  {
+    decryptBlocks(value + 2, length - 2, secret, iv, value);
+  }
+  else
+  {
+    // Salts must have the top bit set and be unique within the packet
+    value[0] = 0x80 | (*salt >> 8);
+    value[1] = *salt;
+    (*salt)++;
+    encryptBlocks(value + 2, length - 2, secret, iv, value);
+  }
+}
 
 RadiusMsg::RadiusMsg()
 {
   packetLength = RADIUS_HEADER_LENGTH;
   retries = 3;
   timeout = 5;
+  stats = 0;
+  identifierAllocated = true;
 }
 
 RadiusMsg::RadiusMsg(RadiusCode code)
+{
+  initRequest(code);
+}
+
+void
+RadiusMsg::initRequest(RadiusCode code)
 {
   packet.code = code;
-  packet.identifier = nextIdentifier++;
   packetLength = RADIUS_HEADER_LENGTH;
   retries = 3;
   timeout = 5;
+  stats = 0;
+  // Not yet: this may run before setup() has set up the random number generator
+  identifierAllocated = false;
+}
+
+void
+RadiusMsg::allocateIdentifier()
+{
+  if (identifierAllocated)
+    return;
+  packet.identifier = newIdentifier();
+  identifierAllocated = true;
+}
+
+void
+RadiusMsg::initReply(RadiusMsg* request, RadiusCode code)
+{
+  packet.code = code;
+  packet.identifier = request->packet.identifier;
+  identifierAllocated = true;
+  packetLength = RADIUS_HEADER_LENGTH;
+  peerAddress = request->peerAddress;
+  peerPort = request->peerPort;
+
+  // Proxy-States of the request go back in the reply, in order (RFC 2865 5.33). The 
+  // reply is empty so far, so there is room for them
+  uint16_t i;
+  for (i = RADIUS_HEADER_LENGTH; i + 2 <= request->packetLength;)
+  {
+    const RadiusAttrHeader* h = (const RadiusAttrHeader*)((uint8_t*)&request->packet + i);
+    if (h->length < 2 || i + h->length > request->packetLength)
+      break; // Malformed
+    if (h->type == RadiusAttrProxyState)
+    {
+      memcpy((uint8_t*)&packet + packetLength, h, h->length);
+      packetLength += h->length;
+    }
+    i += h->length;
+  }
+}
+
+void
+RadiusMsg::setRandom(RadiusRandom* r)
+{
+  randomSource = r ? r : &defaultRandom;
+}
+
+void
+RadiusMsg::fillRandom(uint8_t* data, uint16_t length)
+{
+  randomSource->fill(data, length);
+}
+
+void
+RadiusMsg::setIdle(RadiusIdleFunction i)
+{
+  idleFunction = i;
+}
+
+void
+RadiusMsg::setClock(RadiusClockFunction c)
+{
+  clockFunction = c;
+}
+
+unsigned long
+RadiusMsg::now()
+{
+  return clockFunction ? clockFunction() : millis();
+}
+
+void
+RadiusMsg::idle()
+{
+  if (idleFunction)
+    idleFunction();
+}
+
+void
+RadiusMsg::sleepIdle()
+{
+#ifdef __AVR__
+  // Timers, the SPI bus and interrupts keep running in idle mode
+  set_sleep_mode(SLEEP_MODE_IDLE);
+  sleep_mode();
+#else
+  yield();
+#endif
+}
+
+void
+RadiusMsg::setCapture(RadiusCapture* c)
+{
+  capture = c;
+}
+
+void
+RadiusMsg::setStats(RadiusStats* s)
+{
+  stats = s;
 }
 
 uint8_t 
@@ -61,28 +290,58 @@ RadiusMsg::code()
   return packet.code;
 }
 
-// REVISIT: handle VSAs
-void
-RadiusMsg::addAttr(unsigned type, unsigned vendor, uint8_t* value, uint8_t length)
+uint8_t 
+RadiusMsg::identifier()
+{
+  allocateIdentifier();
+  return packet.identifier;
+}
+
+const uint8_t* 
+RadiusMsg::authenticator()
+{
+  return packet.authenticator;
+}
+
+uint8_t*
+RadiusMsg::appendAttr(unsigned type, unsigned vendor, uint8_t length)
 {
   RadiusAttrHeader* h = (RadiusAttrHeader*)((uint8_t*)&packet + packetLength);
+  if (vendor)
+  {
+    // Vendor Specific Attribute containing a single sub attribute (RFC 2865 5.26)
+    h->type = RadiusAttrVendorSpecific;
+    h->length = length + 8;
+    h->value[0] = (uint32_t)vendor >> 24;
+    h->value[1] = (uint32_t)vendor >> 16;
+    h->value[2] = vendor >> 8;
+    h->value[3] = vendor;
+    packetLength += h->length;
+    h = (RadiusAttrHeader*)(h->value + 4);
+    h->type = type;
+    h->length = length + 2;
+    return h->value;
+  }
+  h->type = type;
+  h->length = length + 2;
+  packetLength += h->length;
+  return h->value;
+}
 
-  memcpy(h->value, value, length);
-  
+void
+RadiusMsg::addAttr(unsigned type, unsigned vendor, uint8_t* value, uint8_t length)
+{
   // Pad some types to multiple of RADIUS_PASSWORD_BLOCK_SIZE(16) octets
+  uint8_t padding = 0;
   if (type == RadiusAttrUserPassword && vendor == 0)
   {
-    uint8_t padding = length % RADIUS_PASSWORD_BLOCK_SIZE;
+    padding = length % RADIUS_PASSWORD_BLOCK_SIZE;
     if (padding)
-    {
       padding = RADIUS_PASSWORD_BLOCK_SIZE - padding;
-      memset(h->value + length, 0, padding);
-      length += padding;
-    }
   }
-  h->type = type;
-  h->length = length + 2;
-  packetLength += h->length;
+  uint8_t* v = appendAttr(type, vendor, length + padding);
+  memcpy(v, value, length);
+  memset(v + length, 0, padding);
 }
 
 void
@@ -98,72 +357,461 @@ RadiusMsg::addAttr(unsigned type, unsigned vendor, uint32_t value)
   return addAttr(type, vendor, (uint8_t*)&v, sizeof(v));
 }
 
+// Largest fragment of a value split across attributes. A Vendor Specific Attribute
+// takes 6 more octets of header
+static uint8_t
+fragmentSize(unsigned vendor)
+{
+  return vendor ? RADIUS_MAX_ATTRIBUTE_SIZE - 6 : RADIUS_MAX_ATTRIBUTE_SIZE;
+}
+
+// Number of octets a value split across attributes takes in the packet, including headers
+static uint16_t
+fragmentsLength(unsigned vendor, uint16_t length)
+{
+  uint8_t size = fragmentSize(vendor);
+  uint16_t fragments = (length + size - 1) / size;
+  return length + fragments * (vendor ? 8 : 2);
+}
+
 uint8_t
-RadiusMsg::getAttr(unsigned type, unsigned vendor, uint8_t* value, uint8_t* length, uint8_t skip)
+RadiusMsg::addAttrFragments(unsigned type, unsigned vendor, const uint8_t* value, uint16_t length)
 {
-  uint8_t i;
-  for (i = RADIUS_HEADER_LENGTH; i < packetLength;)
+  if (packetLength + fragmentsLength(vendor, length) > RADIUS_MAX_SIZE)
+    return false; // No room
+
+  uint8_t size = fragmentSize(vendor);
+  while (length)
   {
-    RadiusAttrHeader* h = (RadiusAttrHeader*)((uint8_t*)&packet + i);
+    uint8_t l = length < size ? length : size;
+    addAttr(type, vendor, (uint8_t*)value, l);
+    value += l;
+    length -= l;
+  }
+  return true;
+}
 
-    if (h->type == type and skip-- == 0)
+uint8_t
+RadiusMsg::addEAPMessage(const uint8_t* eap, uint16_t length)
+{
+  // Check that everything fits before changing the packet
+  uint8_t needMessageAuthenticator = findAttr(RadiusAttrMessageAuthenticator, 0, 0) == 0;
+  uint16_t needed = fragmentsLength(0, length);
+  if (needMessageAuthenticator)
+    needed += RADIUS_AUTHENTICATOR_LENGTH + 2;
+  if (packetLength + needed > RADIUS_MAX_SIZE)
+    return false; // No room
+  if (needMessageAuthenticator)
+    addMessageAuthenticator();
+  return addAttrFragments(RadiusAttrEAPMessage, 0, eap, length);
+}
+
+void
+RadiusMsg::addMessageAuthenticator()
+{
+  addAttrSlot(RadiusAttrMessageAuthenticator, 0, RADIUS_AUTHENTICATOR_LENGTH);
+}
+
+uint8_t
+RadiusMsg::copyState(RadiusMsg* challenge)
+{
+  RadiusAttrView state;
+  if (!challenge->getAttr(RadiusAttrState, 0, &state))
+    return false;
+  addAttr(RadiusAttrState, 0, (uint8_t*)state.value, state.length);
+  return true;
+}
+
+uint8_t
+RadiusMsg::addAttrSalted(unsigned type, unsigned vendor, const uint8_t* value, uint8_t length, uint8_t tag)
+{
+  if (length > RADIUS_MAX_SALTED_SIZE)
+    return false;
+  // Tunnel-Password has a tag before the salt
+  uint8_t tagged = (type == RadiusAttrTunnelPassword && vendor == 0);
+  // The length octet and the data are padded to a multiple of RADIUS_PASSWORD_BLOCK_SIZE(16) octets
+  uint8_t encrypted = (length + RADIUS_PASSWORD_BLOCK_SIZE) & ~(RADIUS_PASSWORD_BLOCK_SIZE - 1);
+  uint8_t total = tagged + 2 + encrypted;
+  if (packetLength + total + (vendor ? 8 : 2) > RADIUS_MAX_SIZE)
+    return false; // No room
+
+  uint8_t* v = appendAttr(type, vendor, total);
+  if (tagged)
+    *v++ = tag;
+  v[0] = v[1] = 0; // Salt is set by sign()
+  v[2] = length;
+  memcpy(v + 3, value, length);
+  memset(v + 3 + length, 0, encrypted - 1 - length);
+  return true;
+}
+
+uint16_t
+RadiusMsg::addAttrSlot(unsigned type, unsigned vendor, uint8_t length)
+{
+  if (packetLength + length + (vendor ? 8 : 2) > RADIUS_MAX_SIZE)
+    return 0; // No room
+
+  uint8_t* v = appendAttr(type, vendor, length);
+  memset(v, 0, length);
+  return v - (uint8_t*)&packet;
+}
+
+uint8_t
+RadiusMsg::setAttrSlot(uint16_t offset, const uint8_t* value, uint8_t length)
+{
+  // The slot must be inside the attributes of the packet
+  if (offset < RADIUS_HEADER_LENGTH + 2 || offset + length > packetLength)
+    return false;
+  memcpy((uint8_t*)&packet + offset, value, length);
+  return true;
+}
+
+uint8_t
+RadiusMsg::setAttrSlot(uint16_t offset, uint32_t value)
+{
+  uint32_t v = htonl(value);
+  return setAttrSlot(offset, (const uint8_t*)&v, sizeof(v));
+}
+
+void
+RadiusMsg::copyTemplate(const RadiusMsg* templ)
+{
+  // Copy only the valid part of the template, not the whole packet buffer
+  memcpy(&packet, &templ->packet, templ->packetLength);
+  packet.identifier = newIdentifier();
+  identifierAllocated = true;
+  packetLength = templ->packetLength;
+  retries = templ->retries;
+  timeout = templ->timeout;
+  stats = templ->stats;
+}
+
+const RadiusAttrHeader*
+RadiusMsg::findAttr(unsigned type, unsigned vendor, uint8_t skip)
+{
+  uint16_t i;
+  for (i = RADIUS_HEADER_LENGTH; i + 2 <= packetLength;)
+  {
+    const RadiusAttrHeader* h = (const RadiusAttrHeader*)((uint8_t*)&packet + i);
+    if (h->length < 2 || i + h->length > packetLength)
+      break; // Malformed
+
+    if (vendor == 0)
     {
-      uint8_t l = h->length - 2;
-      if (l > *length) 
-        l = *length;
-      memcpy(value, h->value, l);
-      *length = l;
-      return true; // Found
+      if (h->type == type && skip-- == 0)
+        return h; // Found
+    }
+    else if (h->type == RadiusAttrVendorSpecific && h->length >= 8
+             && ((uint32_t)h->value[0] << 24 | (uint32_t)h->value[1] << 16 
+                 | (uint32_t)h->value[2] << 8 | h->value[3]) == vendor)
+    {
+      // Look in the sub attributes of this VSA
+      uint8_t j;
+      for (j = 6; j + 2 <= h->length;)
+      {
+        const RadiusAttrHeader* v = (const RadiusAttrHeader*)((uint8_t*)h + j);
+        if (v->length < 2 || j + v->length > h->length)
+          break; // Malformed
+        if (v->type == type && skip-- == 0)
+          return v; // Found
+        j += v->length;
+      }
     }
     i += h->length;
   }
-  return false; // not found
+  return 0; // not found
+}
+
+uint8_t
+RadiusMsg::removeAttr(unsigned type, unsigned vendor, uint8_t skip)
+{
+  if (vendor)
+    return false; // Sub attributes of VSAs cant be removed
+  const RadiusAttrHeader* h = findAttr(type, vendor, skip);
+  if (!h)
+    return false;
+  uint16_t offset = (const uint8_t*)h - (const uint8_t*)&packet;
+  uint8_t length = h->length;
+  memmove((uint8_t*)&packet + offset, (uint8_t*)&packet + offset + length, packetLength - offset - length);
+  packetLength -= length;
+  return true;
+}
+
+uint8_t
+RadiusMsg::countAttr(unsigned type, unsigned vendor)
+{
+  // findAttr can only skip 255 attributes, so stop counting there
+  uint8_t count = 0;
+  while (count < 255 && findAttr(type, vendor, count))
+    count++;
+  return count;
+}
+
+uint8_t
+RadiusMsg::getAttr(unsigned type, unsigned vendor, uint8_t* value, uint8_t* length, uint8_t skip)
+{
+  const RadiusAttrHeader* h = findAttr(type, vendor, skip);
+  if (!h)
+    return false; // not found
+
+  uint8_t l = h->length - 2;
+  if (l > *length) 
+    l = *length;
+  memcpy(value, h->value, l);
+  *length = l;
+  return true; // Found
 }
 
 uint8_t
 RadiusMsg::getAttr(unsigned type, unsigned vendor, uint32_t* value, uint8_t skip)
 {
-  uint32_t v;
-  uint8_t  vLength = sizeof(v);
-  uint8_t ret = getAttr(type, vendor, (uint8_t*)&v, &vLength, skip);
-  if (ret && vLength == 4)
+  const RadiusAttrHeader* h = findAttr(type, vendor, skip);
+  if (!h || h->length != 6)
+    return false;
+
+  // Byte at a time, so it is safe for unaligned values
+  *value = (uint32_t)h->value[0] << 24 | (uint32_t)h->value[1] << 16 
+         | (uint32_t)h->value[2] << 8 | h->value[3];
+  return true;
+}
+
+uint8_t
+RadiusMsg::getAttr(unsigned type, unsigned vendor, RadiusAttrView* view, uint8_t skip)
+{
+  const RadiusAttrHeader* h = findAttr(type, vendor, skip);
+  if (!h)
+    return false;
+
+  view->value = h->value;
+  view->length = h->length - 2;
+  return true;
+}
+
+uint8_t
+RadiusMsg::getAttr(unsigned type, unsigned vendor, IPAddress* value, uint8_t skip)
+{
+  const RadiusAttrHeader* h = findAttr(type, vendor, skip);
+  if (!h || h->length != 6)
+    return false;
+
+  *value = IPAddress(h->value[0], h->value[1], h->value[2], h->value[3]);
+  return true;
+}
+
+uint8_t
+RadiusMsg::getAttrIPv6Address(unsigned type, unsigned vendor, const uint8_t** address, uint8_t skip)
+{
+  const RadiusAttrHeader* h = findAttr(type, vendor, skip);
+  if (!h || h->length != 18)
+    return false;
+
+  *address = h->value;
+  return true;
+}
+
+uint8_t
+RadiusMsg::getAttrIPv6Prefix(unsigned type, unsigned vendor, RadiusIPv6Prefix* prefix, uint8_t skip)
+{
+  // Reserved octet, prefix length, then up to 16 octets of prefix
+  const RadiusAttrHeader* h = findAttr(type, vendor, skip);
+  if (!h || h->length < 4 || h->length > 20 || h->value[1] > 128
+      || (h->value[1] + 7) / 8 > h->length - 4)
+    return false;
+
+  prefix->prefixLength = h->value[1];
+  prefix->prefix = h->value + 2;
+  prefix->length = h->length - 4;
+  return true;
+}
+
+uint8_t
+RadiusMsg::getAttrSalted(unsigned type, unsigned vendor, RadiusAttrView* view, uint8_t skip)
+{
+  const RadiusAttrHeader* h = findAttr(type, vendor, skip);
+  if (!h)
+    return false;
+  uint8_t tagged = (type == RadiusAttrTunnelPassword && vendor == 0);
+  if (h->length < 2 + tagged + 2 + RADIUS_PASSWORD_BLOCK_SIZE)
+    return false; // Malformed
+  // Salt, then the decrypted length octet
+  const uint8_t* v = h->value + tagged + 2;
+  if (v[0] >= h->length - 2 - tagged - 2)
+    return false; // Bad length, probably not decrypted, or wrong secret
+  view->value = v + 1;
+  view->length = v[0];
+  return true;
+}
+
+uint8_t
+RadiusMsg::getUserPassword(RadiusAttrView* view)
+{
+  if (!getAttr(RadiusAttrUserPassword, 0, view))
+    return false;
+  // Strip the padding
+  while (view->length && view->value[view->length - 1] == 0)
+    view->length--;
+  return true;
+}
+
+uint8_t
+RadiusMsg::checkChapPassword(const uint8_t* password, uint8_t length)
+{
+  // CHAP ident, then the response
+  const RadiusAttrHeader* h = findAttr(RadiusAttrChapPassword, 0, 0);
+  if (!h || h->length != RADIUS_AUTHENTICATOR_LENGTH + 3)
+    return false;
+  // The challenge is the CHAP-Challenge if there is one, else the Request Authenticator
+  const uint8_t* challenge = packet.authenticator;
+  uint8_t challengeLength = RADIUS_AUTHENTICATOR_LENGTH;
+  const RadiusAttrHeader* c = findAttr(RadiusAttrCHAPChallenge, 0, 0);
+  if (c)
   {
-   *value = ntohl(v);
-   return true;
+    challenge = c->value;
+    challengeLength = c->length - 2;
   }
-  else
-    return false;
+  
+  // MD5(ident + password + challenge)
+  md5_ctx context;
+  md5_init(&context);
+  md5_update(&context, (uint8_t*)h->value, 1);
+  md5_update(&context, (uint8_t*)password, length);
+  md5_update(&context, (uint8_t*)challenge, challengeLength);
+  RadiusAuthenticator digest;
+  md5_final(digest, &context);
+  return memcmp(digest, h->value + 1, RADIUS_AUTHENTICATOR_LENGTH) == 0;
+}
+
+uint8_t
+RadiusMsg::getAttrFragments(unsigned type, unsigned vendor, RadiusAttrFragments* fragments)
+{
+  fragments->count = 0;
+  fragments->length = 0;
+  const RadiusAttrHeader* h;
+  while ((h = findAttr(type, vendor, fragments->count)))
+  {
+    if (fragments->count >= RADIUS_MAX_FRAGMENTS)
+      return false; // Too many
+    fragments->fragments[fragments->count].value = h->value;
+    fragments->fragments[fragments->count].length = h->length - 2;
+    fragments->length += h->length - 2;
+    fragments->count++;
+  }
+  return fragments->count > 0;
+}
+
+uint8_t
+RadiusMsg::getEAPMessage(RadiusAttrFragments* fragments)
+{
+  return getAttrFragments(RadiusAttrEAPMessage, 0, fragments);
+}
+
+uint16_t
+RadiusMsg::copyFragments(const RadiusAttrFragments* fragments, uint16_t offset, uint8_t* dest, uint16_t length)
+{
+  uint16_t copied = 0;
+  uint8_t i;
+  for (i = 0; i < fragments->count && copied < length; i++)
+  {
+    const RadiusAttrView* f = &fragments->fragments[i];
+    if (offset >= f->length)
+    {
+      offset -= f->length;
+      continue; // Before the wanted octets
+    }
+    uint16_t l = f->length - offset;
+    if (l > length - copied)
+      l = length - copied;
+    memcpy(dest + copied, f->value + offset, l);
+    copied += l;
+    offset = 0;
+  }
+  return copied;
 }
 
 void  
 RadiusMsg::encryptPassword(uint8_t* data, uint8_t length, const char* secret, uint8_t secretLength, uint8_t* iv)
 {
-  uint8_t  i;
-  uint8_t lastround[RADIUS_PASSWORD_BLOCK_SIZE];
-  memcpy(lastround, iv, RADIUS_PASSWORD_BLOCK_SIZE);
-  
-  for (i = 0; i < length; i+= RADIUS_PASSWORD_BLOCK_SIZE)
+  md5_ctx context;
+  secretContext(&context, secret, secretLength);
+  encryptBlocks(data, length, &context, iv, 0);
+}
+
+void  
+RadiusMsg::decryptPassword(uint8_t* data, uint8_t length, const char* secret, uint8_t secretLength, uint8_t* iv)
+{
+  md5_ctx context;
+  secretContext(&context, secret, secretLength);
+  decryptBlocks(data, length, &context, iv, 0);
+}
+
+void
+RadiusMsg::cryptAttrs(const char* secret, uint8_t secretLength, const uint8_t* requestAuthenticator, uint8_t decrypt)
+{
+  md5_ctx context;
+  secretContext(&context, secret, secretLength);
+  uint16_t salt = 0;
+  if (!decrypt)
+    randomSource->fill((uint8_t*)&salt, sizeof(salt));
+
+  uint16_t i;
+  for (i = RADIUS_HEADER_LENGTH; i + 2 <= packetLength;)
   {
-    md5_ctx  context;
-    md5_init(&context);
-    md5_update(&context, (uint8_t*)secret, secretLength);
-    md5_update(&context, lastround, RADIUS_PASSWORD_BLOCK_SIZE);
-    uint8_t digest[RADIUS_PASSWORD_BLOCK_SIZE];
-    md5_final(digest, &context);
-    uint8_t j;
-    for (j = 0; j < RADIUS_PASSWORD_BLOCK_SIZE; j++)
+    RadiusAttrHeader* h = (RadiusAttrHeader*)((uint8_t*)&packet + i);
+    if (h->length < 2 || i + h->length > packetLength)
+      break; // Malformed
+
+    if (h->type == RadiusAttrUserPassword)
     {
-      data[i+j] ^= digest[j];
-      lastround[j] = data[i+j];
+      if (decrypt)
+	decryptBlocks(h->value, h->length - 2, &context, requestAuthenticator, 0);
+      else
+	encryptBlocks(h->value, h->length - 2, &context, requestAuthenticator, 0);
     }
+    else if (h->type == RadiusAttrTunnelPassword && h->length >= 3)
+    {
+      // Skip the tag
+      cryptSalted(h->value + 1, h->length - 3, &context, requestAuthenticator, &salt, decrypt);
+    }
+    else if (h->type == RadiusAttrVendorSpecific && h->length >= 8
+	     && ((uint32_t)h->value[0] << 24 | (uint32_t)h->value[1] << 16 
+		 | (uint32_t)h->value[2] << 8 | h->value[3]) == RadiusVendorMicrosoft)
+    {
+      uint8_t j;
+      for (j = 6; j + 2 <= h->length;)
+      {
+	RadiusAttrHeader* v = (RadiusAttrHeader*)((uint8_t*)h + j);
+	if (v->length < 2 || j + v->length > h->length)
+	  break; // Malformed
+	if (   v->type == RadiusVendorMicrosoftAttrMSMPPESendKey
+	    || v->type == RadiusVendorMicrosoftAttrMSMPPERecvKey)
+	  cryptSalted(v->value, v->length - 2, &context, requestAuthenticator, &salt, decrypt);
+	j += v->length;
+      }
+    }
+    i += h->length;
   }
 }
 
+void
+RadiusMsg::decryptAttrs(const char* secret, uint8_t secretLength, const uint8_t* requestAuthenticator)
+{
+  cryptAttrs(secret, secretLength, requestAuthenticator ? requestAuthenticator : packet.authenticator, true);
+}
+
 void 
 RadiusMsg::sign(const char* secret, uint8_t secretLength, RadiusMsg* original)
 {
+  signReply(secret, secretLength, original ? original->packet.authenticator : 0);
+}
+
+void 
+RadiusMsg::signReply(const char* secret, uint8_t secretLength, const uint8_t* requestAuthenticator)
+{
+  allocateIdentifier();
+  // The length is covered by the authenticators, so must be set first
+  packet.length = htons(packetLength); 
+
   // Set the authenticator
-  uint8_t i;
   uint8_t setRandomAuthenticator = 0;
   if (   packet.code == RadiusCodeAccountingRequest
       || packet.code == RadiusCodeDisconnectRequest
@@ -171,35 +819,41 @@ RadiusMsg::sign(const char* secret, uint8_t secretLength, RadiusMsg* original)
   {
     memset(packet.authenticator, 0, RADIUS_AUTHENTICATOR_LENGTH);
   }
-  else if (original 
+  else if (requestAuthenticator
           && (  packet.code == RadiusCodeAccessAccept
 	     || packet.code == RadiusCodeAccessReject
 	     || packet.code == RadiusCodeAccessChallenge
+	     || packet.code == RadiusCodeAccountingResponse
 	     || packet.code == RadiusCodeDisconnectRequestACKed
 	     || packet.code == RadiusCodeDisconnectRequestNAKed
 	     || packet.code == RadiusCodeChangeFilterRequestACKed
 	     || packet.code == RadiusCodeChangeFilterRequestNAKed))
   {
-    memcpy(packet.authenticator, original->packet.authenticator, RADIUS_AUTHENTICATOR_LENGTH);
+    memcpy(packet.authenticator, requestAuthenticator, RADIUS_AUTHENTICATOR_LENGTH);
   }
   else
   {
-    for (i = 0; i < RADIUS_AUTHENTICATOR_LENGTH; i++)
-      packet.authenticator[i] = rand();
+    // Random, unless the caller has already chosen one, such as for a retransmission
+    if (requestAuthenticator)
+      memcpy(packet.authenticator, requestAuthenticator, RADIUS_AUTHENTICATOR_LENGTH);
+    else
+      randomSource->fill(packet.authenticator, RADIUS_AUTHENTICATOR_LENGTH);
     setRandomAuthenticator = 1;
   }
   
-  // Encrypt any attrs that need it
-  for (i = RADIUS_HEADER_LENGTH; i < packetLength;)
-  {
-    RadiusAttrHeader* h = (RadiusAttrHeader*)((uint8_t*)&packet + i);
+  // Encrypt any attrs that need it, in one pass
+  cryptAttrs(secret, secretLength, packet.authenticator, false);
 
-    if (h->type == RadiusAttrUserPassword)
-    {
-      encryptPassword(h->value, h->length-2, secret, secretLength, packet.authenticator);
-    }
-    i += h->length;
+  // The Message-Authenticator is computed with the request authenticator in the header
+  RadiusAttrHeader* ma = (RadiusAttrHeader*)findAttr(RadiusAttrMessageAuthenticator, 0, 0);
+  if (ma && ma->length == RADIUS_AUTHENTICATOR_LENGTH + 2)
+  {
+    memset(ma->value, 0, RADIUS_AUTHENTICATOR_LENGTH);
+    RadiusAuthenticator digest;
+    messageAuthenticator(secret, secretLength, digest);
+    memcpy(ma->value, digest, RADIUS_AUTHENTICATOR_LENGTH);
   }
+
   if (!setRandomAuthenticator)
   {
     // Compute authenticator
@@ -215,61 +869,182 @@ RadiusMsg::sign(const char* secret, uint8_t secretLength, RadiusMsg* original)
 
 
 uint16_t
-RadiusMsg::sendto(EthernetUDP* Udp, IPAddress server, uint16_t port)
+RadiusMsg::sendto(UDP* Udp, IPAddress server, uint16_t port)
 {
   //uint8_t i;
   //for (i = 0; i < 4; i++)
   //  peerAddress[i] = server[i];
   //peerPort = port;
+  allocateIdentifier();
   packet.length = htons(packetLength); 
   Udp->beginPacket(server, port);
-  Udp->write((const char*)&packet,packetLength);
-  return Udp->endPacket();
+  Udp->write((const uint8_t*)&packet, packetLength);
+  uint16_t ret = Udp->endPacket();
+  if (capture && ret > 0)
+    capture->capture((uint8_t*)&packet, packetLength, server, port, true);
+  return ret;
 }
 
 uint16_t
-RadiusMsg::recv(EthernetUDP* Udp, RadiusMsg* reply)
+RadiusMsg::recv(UDP* Udp, RadiusMsg* reply)
 {
-  packetLength = 0;
-  uint16_t ret = Udp->read((uint8*)&reply->packet, 255); //socket->recvfrom((uint8*)&packet, 255, peerAddress, &peerPort);
-  if (ret < RADIUS_HEADER_LENGTH || ret > RADIUS_MAX_SIZE)
+  reply->packetLength = 0;
+  // Every octet read costs bus transfers on Ethernet controllers such as the W5100, so 
+  // datagrams are checked before reading them, and only the RADIUS packet itself is read. 
+  // Anything left unread is discarded by the next parsePacket()
+  int available = Udp->available();
+  if (available < RADIUS_HEADER_LENGTH)
+    return 0; // Discard
+  if (Udp->read((uint8_t*)&reply->packet, RADIUS_HEADER_LENGTH) != RADIUS_HEADER_LENGTH)
+    return 0; // Discard
+  // Octets beyond the length in the header are padding
+  uint16_t ret = ntohs(reply->packet.length);
+  if (ret < RADIUS_HEADER_LENGTH || ret > RADIUS_MAX_SIZE || ret > available)
+    return 0; // Discard
+  if (ret > RADIUS_HEADER_LENGTH
+      && Udp->read(reply->packet.attrs, ret - RADIUS_HEADER_LENGTH) != ret - RADIUS_HEADER_LENGTH)
     return 0; // Discard
   reply->peerAddress        = Udp->remoteIP();
   reply->peerPort           = Udp->remotePort();
-  packetLength = ret; 
+  reply->packetLength = ret; 
+  reply->identifierAllocated = true;
+  if (capture)
+    capture->capture((uint8_t*)&reply->packet, ret, reply->peerAddress, reply->peerPort, false);
   return ret;
 }
 
+uint16_t
+RadiusMsg::readPacket(Stream* in, uint16_t length)
+{
+  uint16_t wanted = length < RADIUS_MAX_SIZE ? length : RADIUS_MAX_SIZE;
+  uint16_t got = in->readBytes((uint8_t*)&packet, wanted);
+  // Skip anything too big to fit
+  while (length-- > wanted)
+    in->read();
+
+  packetLength = 0;
+  if (got < RADIUS_HEADER_LENGTH)
+    return 0; // Discard
+  uint16_t l = ntohs(packet.length);
+  if (l < RADIUS_HEADER_LENGTH || l > got)
+    return 0; // Discard
+  packetLength = l;
+  identifierAllocated = true;
+  return l;
+}
+
 uint8_t
-RadiusMsg::sendWaitReply(EthernetUDP* Udp, IPAddress server, uint16_t port, RadiusMsg* reply)
+RadiusMsg::sendWaitReply(UDP* Udp, IPAddress server, uint16_t port, RadiusMsg* reply)
 {
-  while (retries-- > 0)
+  uint8_t tries;
+  unsigned long firstSendTime = now();
+  for (tries = 0; tries < retries; tries++)
   {
     uint16_t ret = sendto(Udp, server, port);
-    unsigned long sendTime = millis();
+    unsigned long sendTime = now();
     if (ret <= 0)
       return false;  // Send failed
-    // wait for the timeout
-    while (millis() < sendTime + 1000 * timeout)
+    if (stats)
+    {
+      if (tries)
+        stats->retransmits++;
+      else
+        stats->recordRequest(packet.code);
+    }
+    // wait for the timeout. Subtracting is correct even when the clock wraps around
+    while (now() - sendTime < 1000UL * timeout)
     {
       if (Udp->parsePacket())
       {
-        ret = reply->recv(Udp, reply);
-        if (ret > 0 && reply->packet.identifier == packet.identifier 
-            && reply->peerAddress == server
-            && reply->peerPort == port)  
+        // Check the sender before reading anything
+        ret = Udp->remotePort() == port && Udp->remoteIP() == server ? reply->recv(Udp, reply) : 0;
+        if (ret > 0 && reply->packet.identifier == packet.identifier)
          {
             // This is the reply we are waiting for
+            if (stats)
+            {
+              stats->replies++;
+              stats->recordLatency(now() - firstSendTime);
+            }
             return true; 
          }
+        if (stats)
+          stats->discarded++;
       }
+      else
+        idle(); // Nothing yet
     }
   }
+  if (stats)
+    stats->timeouts++;
   return false;  // No reply
 }
 
 uint8_t
 RadiusMsg::checkAuthenticatorsWithOriginal(const char* secret, uint8_t secretLength, RadiusMsg* original)
+{
+  if (!checkAuthenticators(secret, secretLength, original ? original->packet.authenticator : 0))
+  {
+    if (original && original->stats)
+      original->stats->badAuthenticators++;
+    return false;
+  }
+  return true;
+}
+
+void
+RadiusMsg::messageAuthenticator(const char* secret, uint8_t secretLength, uint8_t* digest)
+{
+  // HMAC-MD5 (RFC 2104) of the whole packet, keyed with the secret
+  uint8_t k[64];
+  uint8_t i;
+  memset(k, 0, sizeof(k));
+  if (secretLength > sizeof(k))
+  {
+    md5_ctx context;
+    md5_init(&context);
+    md5_update(&context, (uint8_t*)secret, secretLength);
+    md5_final(k, &context);
+  }
+  else
+    memcpy(k, secret, secretLength);
+
+  for (i = 0; i < sizeof(k); i++)
+    k[i] ^= 0x36;
+  md5_ctx context;
+  md5_init(&context);
+  md5_update(&context, k, sizeof(k));
+  md5_update(&context, (uint8_t*)&packet, packetLength);
+  md5_final(digest, &context);
+
+  for (i = 0; i < sizeof(k); i++)
+    k[i] ^= 0x36 ^ 0x5c;
+  md5_init(&context);
+  md5_update(&context, k, sizeof(k));
+  md5_update(&context, digest, RADIUS_AUTHENTICATOR_LENGTH);
+  md5_final(digest, &context);
+}
+
+uint8_t
+RadiusMsg::checkMessageAuthenticator(const char* secret, uint8_t secretLength)
+{
+  RadiusAttrHeader* ma = (RadiusAttrHeader*)findAttr(RadiusAttrMessageAuthenticator, 0, 0);
+  if (!ma)
+    return true; // Nothing to check
+  if (ma->length != RADIUS_AUTHENTICATOR_LENGTH + 2)
+    return false;
+
+  // Computed with the Message-Authenticator zeroed
+  RadiusAuthenticator saved, digest;
+  memcpy(saved, ma->value, RADIUS_AUTHENTICATOR_LENGTH);
+  memset(ma->value, 0, RADIUS_AUTHENTICATOR_LENGTH);
+  messageAuthenticator(secret, secretLength, digest);
+  memcpy(ma->value, saved, RADIUS_AUTHENTICATOR_LENGTH);
+  return memcmp(digest, saved, RADIUS_AUTHENTICATOR_LENGTH) == 0;
+}
+
+uint8_t
+RadiusMsg::checkAuthenticators(const char* secret, uint8_t secretLength, const uint8_t* requestAuthenticator)
 {
   RadiusAuthenticator  savedAuthenticator;
   memcpy(savedAuthenticator, packet.authenticator, RADIUS_AUTHENTICATOR_LENGTH);
@@ -280,19 +1055,29 @@ RadiusMsg::checkAuthenticatorsWithOriginal(const char* secret, uint8_t secretLen
   {
     memset(packet.authenticator, 0, RADIUS_AUTHENTICATOR_LENGTH);
   }
-  else if (   packet.code == RadiusCodeAccessAccept
-	   || packet.code == RadiusCodeAccessReject
-	   || packet.code == RadiusCodeAccessChallenge
-	   || packet.code == RadiusCodeDisconnectRequestACKed
-	   || packet.code == RadiusCodeDisconnectRequestNAKed
-	   || packet.code == RadiusCodeChangeFilterRequestACKed
-	   || packet.code == RadiusCodeChangeFilterRequestNAKed)
+  else if (requestAuthenticator
+           && (  packet.code == RadiusCodeAccessAccept
+	      || packet.code == RadiusCodeAccessReject
+	      || packet.code == RadiusCodeAccessChallenge
+	      || packet.code == RadiusCodeAccountingResponse
+	      || packet.code == RadiusCodeDisconnectRequestACKed
+	      || packet.code == RadiusCodeDisconnectRequestNAKed
+	      || packet.code == RadiusCodeChangeFilterRequestACKed
+	      || packet.code == RadiusCodeChangeFilterRequestNAKed))
   {
-    memcpy(packet.authenticator, original->packet.authenticator, RADIUS_AUTHENTICATOR_LENGTH);
+    memcpy(packet.authenticator, requestAuthenticator, RADIUS_AUTHENTICATOR_LENGTH);
+  }
+  else if (   packet.code == RadiusCodeAccessRequest
+	   || packet.code == RadiusCodeStatusServer
+	   || packet.code == RadiusCodeStatusClient)
+  {
+    // Random authenticator, cant check it, but can check the Message-Authenticator
+    return checkMessageAuthenticator(secret, secretLength);
   }
   else
   {
-    return 1; // Random authenticator, cant check it
+    // A reply without the request it answers, or a code that cant be checked
+    return false;
   }
   
   md5_ctx context;
@@ -301,7 +1086,10 @@ RadiusMsg::checkAuthenticatorsWithOriginal(const char* secret, uint8_t secretLen
   md5_update(&context, (uint8_t*)secret, secretLength);
   RadiusAuthenticator  digest;
   md5_final(digest, &context);
+  // The Message-Authenticator is computed with the request authenticator in the header too
+  uint8_t messageAuthenticatorOK = checkMessageAuthenticator(secret, secretLength);
   // Restore the saved authenticator
   memcpy(packet.authenticator, savedAuthenticator, RADIUS_AUTHENTICATOR_LENGTH);
-  return memcmp(digest, savedAuthenticator, RADIUS_AUTHENTICATOR_LENGTH) == 0;
+  return memcmp(digest, savedAuthenticator, RADIUS_AUTHENTICATOR_LENGTH) == 0
+    && messageAuthenticatorOK;
 }
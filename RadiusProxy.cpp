@@ -0,0 +1,193 @@
+// RadiusProxy.cpp
+//
+// RADIUS proxy forwarding requests from RADIUS clients to an upstream RADIUS server
+//
+// $Id: $
+
+#include "RadiusProxy.h"
+
+RadiusProxy::RadiusProxy(UDP* c, UDP* u, IPAddress us, uint16_t usPort,
+                         const char* cs, const char* uss)
+{
+  clientUdp = c;
+  upstreamUdp = u;
+  upstream = us;
+  upstreamPort = usPort;
+  clientSecret = cs;
+  clientSecretLength = strlen(cs);
+  upstreamSecret = uss;
+  upstreamSecretLength = strlen(uss);
+  uint8_t i;
+  for (i = 0; i < RADIUS_PROXY_MAX_PENDING; i++)
+    pending[i].inUse = false;
+  nextIdentifier = 0;
+  cookieSet = false;
+  requests = 0;
+  replies = 0;
+  dropped = 0;
+}
+
+void
+RadiusProxy::forwardRequest()
+{
+  if (   msg.packet.code != RadiusCodeAccessRequest
+      && msg.packet.code != RadiusCodeAccountingRequest)
+  {
+    dropped++;
+    return; // Not something we proxy
+  }
+  if (!msg.checkAuthenticators(clientSecret, clientSecretLength, 0))
+  {
+    dropped++;
+    return;
+  }
+  if (!cookieSet)
+  {
+    // Chosen here rather than in the constructor, which may run before the random generator is ready
+    RadiusMsg::fillRandom(cookie, sizeof(cookie));
+    cookieSet = true;
+  }
+
+  // A retransmission from the client is forwarded again as the same upstream request
+  RadiusProxyPending* p = 0;
+  RadiusProxyPending* free = 0;
+  uint8_t retransmission = false;
+  uint8_t i;
+  for (i = 0; i < RADIUS_PROXY_MAX_PENDING; i++)
+  {
+    RadiusProxyPending* e = &pending[i];
+    if (e->inUse && RadiusMsg::now() - e->time >= RADIUS_PROXY_TIMEOUT)
+      e->inUse = false; // Expired
+    if (!e->inUse)
+    {
+      if (!free)
+	free = e;
+    }
+    else if (e->clientIdentifier == msg.packet.identifier
+	     && e->clientPort == msg.peerPort
+	     && e->clientAddress == msg.peerAddress
+	     && memcmp(e->clientAuthenticator, msg.packet.authenticator, RADIUS_AUTHENTICATOR_LENGTH) == 0)
+    {
+      p = e;
+      retransmission = true;
+      break;
+    }
+  }
+  if (!p)
+    p = free;
+  // Without a CHAP-Challenge, the challenge of a CHAP-Password is the Request Authenticator, 
+  // which is replaced upstream. So it goes upstream in a CHAP-Challenge
+  uint8_t addChallenge =    msg.findAttr(RadiusAttrChapPassword, 0, 0)
+                         && !msg.findAttr(RadiusAttrCHAPChallenge, 0, 0);
+  uint16_t needed = 2 + RADIUS_PROXY_STATE_LENGTH;
+  if (addChallenge)
+    needed += 2 + RADIUS_AUTHENTICATOR_LENGTH;
+  if (!p || msg.packetLength + needed > RADIUS_MAX_SIZE)
+  {
+    dropped++;
+    return; // Table full, or no room for the Proxy-State
+  }
+
+  if (!retransmission)
+  {
+    // Find an identifier not already waiting for a reply upstream
+    uint8_t inUse;
+    do
+    {
+      p->upstreamIdentifier = nextIdentifier++;
+      inUse = false;
+      for (i = 0; i < RADIUS_PROXY_MAX_PENDING; i++)
+	if (pending[i].inUse && pending[i].upstreamIdentifier == p->upstreamIdentifier)
+	  inUse = true;
+    } while (inUse);
+    memcpy(p->clientAuthenticator, msg.packet.authenticator, RADIUS_AUTHENTICATOR_LENGTH);
+    p->clientAddress = msg.peerAddress;
+    p->clientPort = msg.peerPort;
+    p->clientIdentifier = msg.packet.identifier;
+    p->time = RadiusMsg::now();
+    p->inUse = true;
+  }
+
+  // Re-encode for the upstream server
+  msg.decryptAttrs(clientSecret, clientSecretLength, 0);
+  msg.packet.identifier = p->upstreamIdentifier;
+  if (addChallenge)
+    msg.addAttr(RadiusAttrCHAPChallenge, 0, p->clientAuthenticator, RADIUS_AUTHENTICATOR_LENGTH);
+  uint8_t state[RADIUS_PROXY_STATE_LENGTH];
+  memcpy(state, cookie, sizeof(cookie));
+  state[sizeof(cookie)] = p->upstreamIdentifier;
+  msg.addAttr(RadiusAttrProxyState, 0, state, sizeof(state));
+  // Retransmissions keep the same Request Authenticator
+  msg.signReply(upstreamSecret, upstreamSecretLength, retransmission ? p->upstreamAuthenticator : 0);
+  memcpy(p->upstreamAuthenticator, msg.packet.authenticator, RADIUS_AUTHENTICATOR_LENGTH);
+  msg.sendto(upstreamUdp, upstream, upstreamPort);
+  requests++;
+}
+
+void
+RadiusProxy::forwardReply()
+{
+  RadiusProxyPending* p = 0;
+  uint8_t i;
+  for (i = 0; i < RADIUS_PROXY_MAX_PENDING; i++)
+  {
+    if (pending[i].inUse && pending[i].upstreamIdentifier == msg.packet.identifier)
+    {
+      p = &pending[i];
+      break;
+    }
+  }
+  if (   !p
+      || !(msg.peerAddress == upstream)
+      || msg.peerPort != upstreamPort
+      || !msg.checkAuthenticators(upstreamSecret, upstreamSecretLength, p->upstreamAuthenticator))
+  {
+    dropped++;
+    return;
+  }
+
+  // Our Proxy-State is the last one
+  uint8_t count = msg.countAttr(RadiusAttrProxyState, 0);
+  RadiusAttrView state;
+  if (   !count
+      || !msg.getAttr(RadiusAttrProxyState, 0, &state, count - 1)
+      || state.length != RADIUS_PROXY_STATE_LENGTH
+      || memcmp(state.value, cookie, sizeof(cookie)) != 0
+      || state.value[sizeof(cookie)] != p->upstreamIdentifier)
+  {
+    dropped++;
+    return;
+  }
+  msg.removeAttr(RadiusAttrProxyState, 0, count - 1);
+
+  // Re-encode for the client
+  msg.decryptAttrs(upstreamSecret, upstreamSecretLength, p->upstreamAuthenticator);
+  msg.packet.identifier = p->clientIdentifier;
+  msg.signReply(clientSecret, clientSecretLength, p->clientAuthenticator);
+  msg.sendto(clientUdp, p->clientAddress, p->clientPort);
+  p->inUse = false;
+  replies++;
+}
+
+uint8_t
+RadiusProxy::poll()
+{
+  // Forward a burst from each side back to back, but not so much that loop() is starved
+  uint8_t received = 0;
+  uint8_t i;
+  for (i = 0; i < RADIUS_PROXY_BURST && clientUdp->parsePacket(); i++, received++)
+  {
+    if (msg.recv(clientUdp, &msg))
+      forwardRequest();
+    else
+      dropped++;
+  }
+  for (i = 0; i < RADIUS_PROXY_BURST && upstreamUdp->parsePacket(); i++, received++)
+  {
+    if (msg.recv(upstreamUdp, &msg))
+      forwardReply();
+    else
+      dropped++;
+  }
+  return received;
+}
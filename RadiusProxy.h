@@ -0,0 +1,154 @@
+// RadiusProxy.h
+//
+// RADIUS proxy forwarding requests from RADIUS clients to an upstream RADIUS server
+//
+// $Id: $
+
+#ifndef _RADIUSPROXY_H_
+#define _RADIUSPROXY_H_
+
+#include "RadiusMsg.h"
+
+// Maximum number of requests waiting for a reply from the upstream server at once
+#define RADIUS_PROXY_MAX_PENDING 8
+// How long to remember a forwarded request, in milliseconds. Retransmissions from the client
+// within this time are forwarded with the same upstream identifier
+#define RADIUS_PROXY_TIMEOUT 30000
+// Length of the Proxy-State added to forwarded requests
+#define RADIUS_PROXY_STATE_LENGTH 4
+// Maximum number of packets received from each socket in one poll()
+#define RADIUS_PROXY_BURST 8
+
+/////////////////////////////////////////////////////////////////////
+/// \struct RadiusProxyPending
+/// A request forwarded to the upstream server, and who to send the reply to
+typedef struct
+{
+    /// Authenticator of the request from the client, for signing the reply
+    RadiusAuthenticator clientAuthenticator;
+
+    /// Authenticator of the forwarded request, for checking the reply
+    RadiusAuthenticator upstreamAuthenticator;
+
+    /// Address of the client
+    IPAddress           clientAddress;
+
+    /// Port of the client
+    uint16_t            clientPort;
+
+    /// Identifier of the request from the client
+    uint8_t             clientIdentifier;
+
+    /// Identifier of the forwarded request
+    uint8_t             upstreamIdentifier;
+
+    /// RadiusMsg::now() when the request was first forwarded
+    unsigned long       time;
+
+    /// true if this entry is in use
+    uint8_t             inUse;
+
+} RadiusProxyPending;
+
+/////////////////////////////////////////////////////////////////////
+/// \class RadiusProxy RadiusProxy.h <RadiusProxy.h>
+/// \brief Class to proxy RADIUS requests from clients to an upstream RADIUS server
+///
+/// Receives requests from RADIUS clients on one UDP socket and forwards them to an upstream
+/// RADIUS server from another, then forwards the replies back to the clients.
+/// Forwarded requests are re-encoded for the upstream server: the identifier is remapped to
+/// one that is unique upstream, encrypted attributes are decrypted with the client secret and
+/// encrypted again with the upstream secret, a Proxy-State is added, and the request is signed
+/// with the upstream secret. Signing gives the request a new Request Authenticator, so a 
+/// CHAP-Password that was answering the old one is forwarded with the old one as its 
+/// CHAP-Challenge. Replies are checked with the upstream secret, the Proxy-State is
+/// removed, and they are re-encoded and signed with the client secret for the original request.
+///
+/// Each packet is received once into a single RadiusMsg, modified in place and sent from
+/// there, so there is at most one copy of each packet. Only a small table of
+/// RADIUS_PROXY_MAX_PENDING identifier remappings is kept.
+/// When the client retransmits a request, it is forwarded again with the same upstream
+/// identifier. Retransmission is left to the clients.
+///
+/// All clients must use the same shared secret. Works with any Arduino UDP sockets, such as 
+/// EthernetUDP or WiFiUDP.
+/// There are no threads: call poll() regularly from loop(). Each poll() forwards a burst of
+/// waiting requests, then a burst of waiting replies.
+class RadiusProxy
+{
+private:
+    /// Socket requests are received from clients on, and replies sent back to them
+    UDP*               clientUdp;
+
+    /// Socket requests are forwarded to the upstream server from, and replies received on
+    UDP*               upstreamUdp;
+
+    /// Address of the upstream server
+    IPAddress          upstream;
+
+    /// Port of the upstream server
+    uint16_t           upstreamPort;
+
+    /// Secret shared with the clients
+    const char*        clientSecret;
+
+    /// Length of clientSecret
+    uint8_t            clientSecretLength;
+
+    /// Secret shared with the upstream server
+    const char*        upstreamSecret;
+
+    /// Length of upstreamSecret
+    uint8_t            upstreamSecretLength;
+
+    /// The identifier remapping table
+    RadiusProxyPending pending[RADIUS_PROXY_MAX_PENDING];
+
+    /// The next upstream identifier to try
+    uint8_t            nextIdentifier;
+
+    /// Prefix of every Proxy-State added by this proxy, to tell them from those of other proxies
+    uint8_t            cookie[RADIUS_PROXY_STATE_LENGTH - 1];
+
+    /// true once cookie has been chosen
+    uint8_t            cookieSet;
+
+    /// Every packet is received into and sent from here
+    RadiusMsg          msg;
+
+    /// Forward the request in msg to the upstream server
+    void               forwardRequest();
+
+    /// Forward the reply in msg to the client
+    void               forwardReply();
+
+public:
+    /// Number of requests forwarded to the upstream server, including retransmissions
+    uint32_t           requests;
+
+    /// Number of replies forwarded to clients
+    uint32_t           replies;
+
+    /// Number of packets dropped because they were malformed, had a bad authenticator,
+    /// matched no forwarded request, or the table was full
+    uint32_t           dropped;
+
+    /// Constructor
+    /// \param[in] clientUdp Socket to receive requests from clients on. Must already be begun on
+    /// the port the clients send to
+    /// \param[in] upstreamUdp Socket to forward requests to the upstream server from. Must
+    /// already be begun on another port
+    /// \param[in] upstream Address of the upstream RADIUS server
+    /// \param[in] upstreamPort Port of the upstream RADIUS server
+    /// \param[in] clientSecret Secret shared with the clients
+    /// \param[in] upstreamSecret Secret shared with the upstream server
+    RadiusProxy(UDP* clientUdp, UDP* upstreamUdp, IPAddress upstream, uint16_t upstreamPort,
+                const char* clientSecret, const char* upstreamSecret);
+
+    /// Forward waiting requests and replies, up to RADIUS_PROXY_BURST of each. 
+    /// Call regularly from loop()
+    /// \return The number of packets received
+    uint8_t            poll();
+};
+
+#endif
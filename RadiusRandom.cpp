@@ -0,0 +1,150 @@
+// RadiusRandom.cpp
+//
+// ChaCha20 based random number generator for RADIUS authenticators and identifiers
+//
+// $Id: $
+
+#include "RadiusRandom.h"
+#if defined(__linux__)
+#include <stdio.h>
+#endif
+
+// Entropy source for seeding, if any
+static uint32_t (*entropySource)() = 0;
+
+#define ROTL32(v, n) (((v) << (n)) | ((v) >> (32 - (n))))
+#define QUARTERROUND(a, b, c, d) \
+  a += b; d ^= a; d = ROTL32(d, 16); \
+  c += d; b ^= c; b = ROTL32(b, 12); \
+  a += b; d ^= a; d = ROTL32(d, 8);  \
+  c += d; b ^= c; b = ROTL32(b, 7);
+
+// ChaCha20 block function (RFC 7539), with a zero nonce
+static void chacha20Block(const uint32_t key[8], uint32_t counter, uint8_t out[RADIUS_RANDOM_BLOCK_SIZE])
+{
+  uint32_t input[16] = 
+  {
+    0x61707865, 0x3320646e, 0x79622d32, 0x6b206574, // "expand 32-byte k"
+    key[0], key[1], key[2], key[3], key[4], key[5], key[6], key[7],
+    counter, 0, 0, 0
+  };
+  uint32_t x[16];
+  uint8_t i;
+  for (i = 0; i < 16; i++)
+    x[i] = input[i];
+  for (i = 0; i < 10; i++)
+  {
+    QUARTERROUND(x[0], x[4], x[8],  x[12]);
+    QUARTERROUND(x[1], x[5], x[9],  x[13]);
+    QUARTERROUND(x[2], x[6], x[10], x[14]);
+    QUARTERROUND(x[3], x[7], x[11], x[15]);
+    QUARTERROUND(x[0], x[5], x[10], x[15]);
+    QUARTERROUND(x[1], x[6], x[11], x[12]);
+    QUARTERROUND(x[2], x[7], x[8],  x[13]);
+    QUARTERROUND(x[3], x[4], x[9],  x[14]);
+  }
+  for (i = 0; i < 16; i++)
+  {
+    uint32_t v = x[i] + input[i];
+    out[i * 4]     = v;
+    out[i * 4 + 1] = v >> 8;
+    out[i * 4 + 2] = v >> 16;
+    out[i * 4 + 3] = v >> 24;
+  }
+}
+
+RadiusRandom::RadiusRandom()
+{
+  memset(key, 0, sizeof(key));
+  counter = 0;
+  next = sizeof(buffer);
+  seeded = false;
+}
+
+void
+RadiusRandom::setEntropySource(uint32_t (*source)())
+{
+  entropySource = source;
+}
+
+void
+RadiusRandom::refill()
+{
+  uint8_t i;
+  for (i = 0; i < RADIUS_RANDOM_BLOCKS; i++)
+    chacha20Block(key, counter++, buffer + i * RADIUS_RANDOM_BLOCK_SIZE);
+
+  // Fast key erasure: the first octets become the next key, and are never served
+  memcpy(key, buffer, RADIUS_RANDOM_KEY_SIZE);
+  memset(buffer, 0, RADIUS_RANDOM_KEY_SIZE);
+  next = RADIUS_RANDOM_KEY_SIZE;
+}
+
+void
+RadiusRandom::seed(const uint8_t* data, uint16_t length)
+{
+  uint8_t* k = (uint8_t*)key;
+  uint16_t i;
+  for (i = 0; i < length; i++)
+    k[i % RADIUS_RANDOM_KEY_SIZE] ^= data[i];
+  // Mix the new key through ChaCha20, and discard any output generated with the old key
+  refill();
+}
+
+void
+RadiusRandom::seedFromSource()
+{
+  seeded = true;
+  uint32_t samples[RADIUS_RANDOM_SEED_SAMPLES];
+  uint8_t i;
+#if defined(__linux__)
+  FILE* f = fopen("/dev/urandom", "rb");
+  if (f)
+  {
+    size_t got = fread(samples, 1, sizeof(samples), f);
+    fclose(f);
+    if (got == sizeof(samples))
+    {
+      seed((uint8_t*)samples, sizeof(samples));
+      return;
+    }
+  }
+#endif
+  for (i = 0; i < RADIUS_RANDOM_SEED_SAMPLES; i++)
+  {
+    if (entropySource)
+      samples[i] = entropySource();
+    else
+      samples[i] = (uint32_t)analogRead(A0) << 24 ^ micros();
+  }
+  seed((uint8_t*)samples, sizeof(samples));
+}
+
+void
+RadiusRandom::fill(uint8_t* data, uint16_t length)
+{
+  if (!seeded)
+    seedFromSource();
+  while (length)
+  {
+    if (next >= sizeof(buffer))
+      refill();
+    uint16_t n = sizeof(buffer) - next;
+    if (n > length)
+      n = length;
+    memcpy(data, buffer + next, n);
+    // Served octets are erased, so they cannot be recovered later
+    memset(buffer + next, 0, n);
+    next += n;
+    data += n;
+    length -= n;
+  }
+}
+
+uint8_t
+RadiusRandom::byte()
+{
+  uint8_t b;
+  fill(&b, 1);
+  return b;
+}
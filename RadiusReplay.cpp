@@ -0,0 +1,230 @@
+// RadiusReplay.cpp
+//
+// Replays RADIUS packets from a pcap capture through the decoding and verification code
+//
+// $Id: $
+
+#include "RadiusReplay.h"
+
+RadiusReplay::RadiusReplay(Stream* stream, const char* s, uint8_t sl)
+{
+  in = stream;
+  secret = s;
+  secretLength = sl;
+  plan = 0;
+  paced = false;
+  started = false;
+  nextPending = 0;
+  uint8_t i;
+  for (i = 0; i < RADIUS_REPLAY_MAX_PENDING; i++)
+    pending[i].inUse = false;
+  packets = verified = failed = unmatched = unverifiable = malformed = skipped = 0;
+}
+
+uint32_t
+RadiusReplay::read32()
+{
+  uint8_t b[4];
+  if (in->readBytes(b, 4) != 4)
+    return 0;
+  if (bigEndian)
+    return (uint32_t)b[0] << 24 | (uint32_t)b[1] << 16 | (uint32_t)b[2] << 8 | b[3];
+  else
+    return (uint32_t)b[3] << 24 | (uint32_t)b[2] << 16 | (uint32_t)b[1] << 8 | b[0];
+}
+
+void
+RadiusReplay::skip(uint32_t length)
+{
+  while (length--)
+    in->read();
+}
+
+void
+RadiusReplay::setPlan(RadiusAttrPlan* p)
+{
+  plan = p;
+}
+
+void
+RadiusReplay::setPaced(uint8_t p)
+{
+  paced = p;
+}
+
+uint8_t
+RadiusReplay::begin()
+{
+  bigEndian = false;
+  uint32_t magic = read32();
+  if (magic == 0xd4c3b2a1 || magic == 0x4d3cb2a1)
+    bigEndian = true;
+  else if (magic != 0xa1b2c3d4 && magic != 0xa1b23c4d)
+    return false; // Not a pcap file
+
+  skip(16); // Version, timezone, accuracy, snaplen
+  linkType = read32();
+  return linkType == RADIUS_REPLAY_LINKTYPE_ETHERNET || linkType == RADIUS_REPLAY_LINKTYPE_RAW;
+}
+
+uint8_t
+RadiusReplay::next(RadiusMsg* msg)
+{
+  while (in->available())
+  {
+    // pcap record header. Nanosecond captures are paced slightly wrongly, which does not matter
+    uint32_t seconds = read32();
+    uint32_t fraction = read32();
+    uint32_t length = read32();
+    read32(); // Original length
+
+    if (paced)
+    {
+      uint32_t millisecond = fraction / 1000;
+      if (!started)
+      {
+        firstCaptureSeconds = seconds;
+        firstCaptureMillis = millisecond;
+        firstReplayTime = RadiusMsg::now();
+        started = true;
+      }
+      // Relative to the first packet, so epoch times dont overflow. Packets captured
+      // out of order, before the first, are replayed at once
+      long due = (long)(seconds - firstCaptureSeconds) * 1000 + (long)millisecond - (long)firstCaptureMillis;
+      while (due > 0 && (long)(RadiusMsg::now() - firstReplayTime) < due)
+        RadiusMsg::idle(); // Lets a virtual clock advance
+    }
+
+    // Link layer header
+    uint8_t header[20];
+    if (linkType == RADIUS_REPLAY_LINKTYPE_ETHERNET)
+    {
+      if (length < 14)
+      {
+        skip(length);
+        skipped++;
+        continue;
+      }
+      in->readBytes(header, 14);
+      length -= 14;
+      if (header[12] == 0x81 && header[13] == 0x00 && length >= 4)
+      {
+        // 802.1Q VLAN tag
+        in->readBytes(header + 12, 4);
+        header[12] = header[14];
+        header[13] = header[15];
+        length -= 4;
+      }
+      if (header[12] != 0x08 || header[13] != 0x00)
+      {
+        skip(length);
+        skipped++;
+        continue; // Not IPv4
+      }
+    }
+
+    // IPv4 header
+    if (length < 28 || in->readBytes(header, 20) != 20)
+    {
+      skip(length);
+      skipped++;
+      continue;
+    }
+    length -= 20;
+    uint8_t ihl = (header[0] & 0x0f) * 4;
+    if ((header[0] >> 4) != 4 || ihl < 20 || header[9] != 17 || (header[6] & 0x3f) || header[7] 
+        || length < (uint32_t)ihl - 20 + 8)
+    {
+      skip(length);
+      skipped++;
+      continue; // Not UDP, or fragmented
+    }
+    IPAddress src(header[12], header[13], header[14], header[15]);
+    IPAddress dst(header[16], header[17], header[18], header[19]);
+    skip(ihl - 20); // IP options
+    length -= ihl - 20;
+
+    // UDP header
+    uint8_t udp[8];
+    in->readBytes(udp, 8);
+    length -= 8;
+    uint16_t srcPort = udp[0] << 8 | udp[1];
+    uint16_t dstPort = udp[2] << 8 | udp[3];
+
+    packets++;
+    if (!msg->readPacket(in, length))
+    {
+      malformed++;
+      continue;
+    }
+    if (plan)
+      plan->extract(msg);
+
+    uint8_t code = msg->code();
+    uint8_t i;
+    RadiusAttrView view;
+    if (   code == RadiusCodeAccountingRequest
+        || code == RadiusCodeDisconnectRequest
+        || code == RadiusCodeChangeFilterRequest)
+    {
+      if (msg->checkAuthenticators(secret, secretLength, 0))
+        verified++;
+      else
+        failed++;
+    }
+    else if (   code == RadiusCodeAccessAccept
+             || code == RadiusCodeAccessReject
+             || code == RadiusCodeAccessChallenge
+             || code == RadiusCodeAccountingResponse
+             || code == RadiusCodeDisconnectRequestACKed
+             || code == RadiusCodeDisconnectRequestNAKed
+             || code == RadiusCodeChangeFilterRequestACKed
+             || code == RadiusCodeChangeFilterRequestNAKed)
+    {
+      // Find the request this is a reply to
+      for (i = 0; i < RADIUS_REPLAY_MAX_PENDING; i++)
+        if (   pending[i].inUse 
+            && pending[i].identifier == msg->identifier()
+            && pending[i].address == dst
+            && pending[i].port == dstPort)
+          break;
+      if (i == RADIUS_REPLAY_MAX_PENDING)
+        unmatched++;
+      else if (msg->checkAuthenticators(secret, secretLength, pending[i].authenticator))
+        verified++;
+      else
+        failed++;
+    }
+    else if (   (code == RadiusCodeAccessRequest || code == RadiusCodeStatusServer)
+             && msg->getAttr(RadiusAttrMessageAuthenticator, 0, &view))
+    {
+      // The random authenticator cant be checked, but the Message-Authenticator can
+      if (msg->checkAuthenticators(secret, secretLength, 0))
+        verified++;
+      else
+        failed++;
+    }
+    else
+    {
+      unverifiable++;
+    }
+
+    if (   code == RadiusCodeAccessRequest
+        || code == RadiusCodeAccountingRequest
+        || code == RadiusCodeDisconnectRequest
+        || code == RadiusCodeChangeFilterRequest
+        || code == RadiusCodeStatusServer)
+    {
+      // Remember the request, replacing the oldest
+      RadiusReplayPending* p = &pending[nextPending];
+      nextPending = (nextPending + 1) % RADIUS_REPLAY_MAX_PENDING;
+      p->address = src;
+      p->port = srcPort;
+      p->identifier = msg->identifier();
+      p->inUse = true;
+      memcpy(p->authenticator, msg->authenticator(), RADIUS_AUTHENTICATOR_LENGTH);
+    }
+    return true;
+  }
+  return false; // End of capture
+}
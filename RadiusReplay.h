@@ -0,0 +1,147 @@
+// RadiusReplay.h
+//
+// Replays RADIUS packets from a pcap capture through the decoding and verification code
+//
+// $Id: $
+
+#ifndef _RADIUSREPLAY_H_
+#define _RADIUSREPLAY_H_
+
+#include "RadiusMsg.h"
+#include "RadiusAttrPlan.h"
+
+// Number of recent requests remembered for verifying the authenticators of their replies
+#define RADIUS_REPLAY_MAX_PENDING 8
+// pcap link types that can be replayed
+#define RADIUS_REPLAY_LINKTYPE_ETHERNET 1
+#define RADIUS_REPLAY_LINKTYPE_RAW      101
+
+/////////////////////////////////////////////////////////////////////
+/// \struct RadiusReplayPending
+/// A recently replayed request, remembered so the authenticator of its reply can be checked
+typedef struct
+{
+    /// Source address of the request
+    IPAddress           address;
+
+    /// Source port of the request
+    uint16_t            port;
+
+    /// RADIUS identifier of the request
+    uint8_t             identifier;
+
+    /// true if this entry holds a request
+    uint8_t             inUse;
+
+    /// The Request Authenticator
+    RadiusAuthenticator authenticator;
+
+} RadiusReplayPending;
+
+/////////////////////////////////////////////////////////////////////
+/// \class RadiusReplay RadiusReplay.h <RadiusReplay.h>
+/// \brief Class to feed captured RADIUS traffic through the library's decoding and verification
+///
+/// Reads a pcap capture file, such as one written by RadiusCapture or tcpdump, from a Stream 
+/// such as a File on an SD card. Each UDP packet is parsed into a RadiusMsg, attributes are
+/// extracted with an optional RadiusAttrPlan, and authenticators are checked with the RADIUS
+/// shared secret:
+/// \li Accounting-Request, Disconnect-Request and Change-Filter-Request authenticators 
+/// are checked directly
+/// \li Reply authenticators are checked against the authenticator of the matching request,
+/// if it is one of the last RADIUS_REPLAY_MAX_PENDING requests replayed
+/// \li Access-Request and Status-Server authenticators are random and cannot be checked
+///
+/// Packets can be replayed as fast as possible, or at the pacing they were captured with.
+/// Captures with Ethernet or raw IPv4 link types are supported. Non-UDP and 
+/// fragmented packets are skipped.
+class RadiusReplay
+{
+private:
+    /// Where the capture is read from
+    Stream*             in;
+
+    /// The RADIUS shared secret
+    const char*         secret;
+
+    /// Length of the secret in octets
+    uint8_t             secretLength;
+
+    /// Attributes to extract from each packet, or 0
+    RadiusAttrPlan*     plan;
+
+    /// true if the capture file is big endian
+    uint8_t             bigEndian;
+
+    /// The pcap link type of the capture
+    uint32_t            linkType;
+
+    /// true to replay packets at the rate they were captured
+    uint8_t             paced;
+
+    /// Capture time of the first packet, in seconds and milliseconds, and the time it was replayed
+    uint32_t            firstCaptureSeconds;
+    uint32_t            firstCaptureMillis;
+    unsigned long       firstReplayTime;
+    uint8_t             started;
+
+    /// Recently replayed requests, used as a ring
+    RadiusReplayPending pending[RADIUS_REPLAY_MAX_PENDING];
+    uint8_t             nextPending;
+
+    /// Read a 32 bit integer in the byte order of the capture file
+    uint32_t            read32();
+
+    /// Skip octets in the input
+    void                skip(uint32_t length);
+
+public:
+    /// Number of RADIUS packets replayed
+    uint32_t packets;
+
+    /// Number of packets with a correct authenticator
+    uint32_t verified;
+
+    /// Number of packets with an incorrect authenticator
+    uint32_t failed;
+
+    /// Number of replies whose request was not found, and so could not be checked
+    uint32_t unmatched;
+
+    /// Number of requests with random authenticators and no Message-Authenticator, which 
+    /// cannot be checked
+    uint32_t unverifiable;
+
+    /// Number of UDP packets that were not valid RADIUS packets
+    uint32_t malformed;
+
+    /// Number of captured packets that were not UDP over IPv4, or were fragmented
+    uint32_t skipped;
+
+    /// Constructor
+    /// \param[in] in The stream to read the pcap capture from
+    /// \param[in] secret The RADIUS shared secret used to check authenticators
+    /// \param[in] secretLength Length of the secret in octets
+    RadiusReplay(Stream* in, const char* secret, uint8_t secretLength);
+
+    /// Read the pcap file header. Call once before next()
+    /// \return true if the stream is a pcap capture with a supported link type
+    uint8_t  begin();
+
+    /// Extract the attributes of a RadiusAttrPlan from every replayed packet
+    /// \param[in] plan The plan to use, or 0 for none
+    void     setPlan(RadiusAttrPlan* plan);
+
+    /// Replay the packets at the rate they were captured, instead of as fast as possible.
+    /// \param[in] paced true to wait until each packet is due
+    void     setPaced(uint8_t paced);
+
+    /// Replay the next RADIUS packet in the capture: parse it into msg, extract attributes 
+    /// and check its authenticator, updating the counters.
+    /// \param[in] msg Filled in with the replayed packet
+    /// Packets that are not valid RADIUS messages are counted in malformed and skipped.
+    /// \return true if a packet was replayed, false at the end of the capture
+    uint8_t  next(RadiusMsg* msg);
+};
+
+#endif
@@ -0,0 +1,149 @@
+// RadiusServer.cpp
+//
+// Cooperative RADIUS server with a queue of received requests
+//
+// $Id: $
+
+#include "RadiusServer.h"
+
+RadiusServer::RadiusServer(UDP* u, const char* s, RadiusServerHandler h)
+{
+  udp = u;
+  secret = s;
+  secretLength = strlen(s);
+  handler = h;
+  inUse = 0;
+  waiting = 0;
+  replySlot = 0;
+  requests = 0;
+  replies = 0;
+  dropped = 0;
+  duplicates = 0;
+  maxDepth = 0;
+}
+
+void
+RadiusServer::receive()
+{
+  // Find a free slot. If there is none, drop the request: the next parsePacket() discards 
+  // it, so it does not block the socket
+  uint8_t slot;
+  for (slot = 0; slot < RADIUS_SERVER_QUEUE_SIZE && (inUse & (1 << slot)); slot++)
+    ;
+  if (slot >= RADIUS_SERVER_QUEUE_SIZE)
+  {
+    dropped++;
+    return;
+  }
+
+  RadiusMsg* msg = &queue[slot];
+  if (   !msg->recv(udp, msg)
+      || !msg->checkAuthenticators(secret, secretLength, 0))
+  {
+    dropped++;
+    return;
+  }
+
+  // A retransmission of a request that is still queued
+  uint8_t i;
+  for (i = 0; i < RADIUS_SERVER_QUEUE_SIZE; i++)
+  {
+    RadiusMsg* q = &queue[i];
+    if (   (inUse & (1 << i))
+	&& q->packet.identifier == msg->packet.identifier
+	&& q->peerPort == msg->peerPort
+	&& q->peerAddress == msg->peerAddress
+	&& memcmp(q->packet.authenticator, msg->packet.authenticator, RADIUS_AUTHENTICATOR_LENGTH) == 0)
+    {
+      duplicates++;
+      return;
+    }
+  }
+
+  msg->decryptAttrs(secret, secretLength, 0);
+  inUse |= 1 << slot;
+  waiting |= 1 << slot;
+  requests++;
+  uint8_t d = depth();
+  if (d > maxDepth)
+    maxDepth = d;
+}
+
+uint8_t
+RadiusServer::dispatch()
+{
+  uint8_t handled = 0;
+  uint8_t slot;
+  for (slot = 0; slot < RADIUS_SERVER_QUEUE_SIZE; slot++)
+  {
+    if (!(waiting & (1 << slot)))
+      continue;
+    waiting &= ~(1 << slot);
+    handled++;
+    if (handler(this, slot, &queue[slot]) == RadiusServerDone)
+      inUse &= ~(1 << slot); // In case the handler neither replied nor dropped
+  }
+  return handled;
+}
+
+uint8_t
+RadiusServer::poll()
+{
+  // Take in a batch of waiting requests first, so slow handlers cant hold up reception, 
+  // then handle the batch back to back. When a burst fills the queue, handle what has been
+  // queued so far to free slots, and carry on receiving
+  uint8_t handled = 0;
+  uint8_t received;
+  for (received = 0; received < RADIUS_SERVER_BURST && udp->parsePacket(); received++)
+  {
+    if (inUse == (uint16_t)((1UL << RADIUS_SERVER_QUEUE_SIZE) - 1))
+      handled += dispatch();
+    receive();
+  }
+  return handled + dispatch();
+}
+
+RadiusMsg*
+RadiusServer::reply(uint8_t slot, RadiusCode code)
+{
+  replySlot = slot;
+  replyMsg.initReply(&queue[slot], code);
+  return &replyMsg;
+}
+
+uint8_t
+RadiusServer::sendReply()
+{
+  RadiusMsg* request = &queue[replySlot];
+  replyMsg.sign(secret, secretLength, request);
+  uint8_t ret = replyMsg.sendto(udp, replyMsg.peerAddress, replyMsg.peerPort) > 0;
+  inUse &= ~(1 << replySlot);
+  if (ret)
+    replies++;
+  return ret;
+}
+
+void
+RadiusServer::drop(uint8_t slot)
+{
+  if (inUse & (1 << slot))
+    dropped++;
+  inUse &= ~(1 << slot);
+  waiting &= ~(1 << slot);
+}
+
+RadiusMsg*
+RadiusServer::request(uint8_t slot)
+{
+  return &queue[slot];
+}
+
+uint8_t
+RadiusServer::depth()
+{
+  uint8_t d = 0;
+  uint16_t bits;
+  for (bits = inUse; bits; bits &= bits - 1)
+    d++;
+  return d;
+}
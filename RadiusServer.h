@@ -0,0 +1,160 @@
+// RadiusServer.h
+//
+// Cooperative RADIUS server with a queue of received requests
+//
+// $Id: $
+
+#ifndef _RADIUSSERVER_H_
+#define _RADIUSSERVER_H_
+
+#include "RadiusMsg.h"
+
+// Maximum number of requests queued or being handled at once, up to 16. Each takes a RadiusMsg,
+// just over RADIUS_MAX_SIZE octets of RAM
+#ifndef RADIUS_SERVER_QUEUE_SIZE
+#define RADIUS_SERVER_QUEUE_SIZE 4
+#endif
+#if RADIUS_SERVER_QUEUE_SIZE > 16
+#error RADIUS_SERVER_QUEUE_SIZE must be no more than 16
+#endif
+// Maximum number of requests received in one poll(), so a burst cant keep poll() from 
+// returning to loop()
+#ifndef RADIUS_SERVER_BURST
+#define RADIUS_SERVER_BURST 16
+#endif
+
+// What a RadiusServerHandler did with a request
+typedef enum
+{
+    RadiusServerDone = 0,
+    RadiusServerDeferred,
+} RadiusServerResult;
+
+class RadiusServer;
+
+/// Handler for requests received by a RadiusServer. Called once for each request.
+/// Either replies at once with RadiusServer::reply() and RadiusServer::sendReply(), or drops
+/// the request with RadiusServer::drop(), and returns RadiusServerDone, or returns
+/// RadiusServerDeferred and does one of those later, such as when a slow lookup has finished.
+/// The request is decrypted, so getUserPassword() and getAttrSalted() can be used.
+/// \param[in] server The server that received the request
+/// \param[in] slot The queue slot of the request, for reply(), sendReply() and drop()
+/// \param[in] request The request
+/// \return RadiusServerDone if the request has been replied to or dropped, else RadiusServerDeferred
+typedef RadiusServerResult (*RadiusServerHandler)(RadiusServer* server, uint8_t slot, RadiusMsg* request);
+
+/////////////////////////////////////////////////////////////////////
+/// \class RadiusServer RadiusServer.h <RadiusServer.h>
+/// \brief Class to receive RADIUS requests and send replies
+///
+/// Receives RADIUS requests on a UDP socket, checks their authenticators, decrypts them,
+/// and queues them for a handler function, which builds and sends the reply.
+/// Works with any Arduino UDP socket, such as EthernetUDP or WiFiUDP.
+/// There are no threads: call poll() regularly from loop(). Each poll() first receives a batch of
+/// waiting requests into free queue slots, then calls the handler for each newly queued request,
+/// back to back. During a burst, when the queue fills up, the requests queued so far are
+/// handled to free their slots, and reception continues, up to RADIUS_SERVER_BURST requests
+/// per poll(). The rest of a longer burst waits in the socket for the next poll().
+///
+/// A handler that has to wait for something slow, such as a directory lookup, returns
+/// RadiusServerDeferred and replies later. Its request keeps its queue slot until then, but
+/// reception continues: new requests are queued in the other slots and handled meanwhile.
+/// When all RADIUS_SERVER_QUEUE_SIZE slots are in use by deferred requests, new requests are dropped,
+/// so the UDP socket never fills up, and the clients retransmit them later.
+/// Retransmissions of a request that is still queued are dropped, so a slow request is
+/// handled only once.
+/// The number of slots in use is available from depth(), and the most ever in use
+/// from maxDepth.
+///
+/// Replies are built one at a time in a single RadiusMsg, so only one reply can be in
+/// progress at once: call reply(), add the attributes, and call sendReply() without
+/// returning to loop() in between.
+class RadiusServer
+{
+private:
+    /// The socket requests are received on
+    UDP*                udp;
+
+    /// The shared secret
+    const char*         secret;
+
+    /// Length of secret
+    uint8_t             secretLength;
+
+    /// Called for each request
+    RadiusServerHandler handler;
+
+    /// The queued requests
+    RadiusMsg           queue[RADIUS_SERVER_QUEUE_SIZE];
+
+    /// Bit mask of the slots in use
+    uint16_t            inUse;
+
+    /// Bit mask of the slots whose request has not yet been handed to the handler
+    uint16_t            waiting;
+
+    /// The reply being built
+    RadiusMsg           replyMsg;
+
+    /// The slot the reply being built is for
+    uint8_t             replySlot;
+
+    /// Receive one request into a free slot
+    void                receive();
+
+    /// Call the handler for each request not yet handed to it
+    /// \return The number of requests handed to the handler
+    uint8_t             dispatch();
+
+public:
+    /// Number of requests received and queued
+    uint32_t            requests;
+
+    /// Number of replies sent
+    uint32_t            replies;
+
+    /// Number of requests dropped because the queue was full, or they were malformed,
+    /// had a bad authenticator, or were dropped by the handler
+    uint32_t            dropped;
+
+    /// Number of retransmissions dropped because the request was already queued
+    uint32_t            duplicates;
+
+    /// The most slots ever in use at once
+    uint8_t             maxDepth;
+
+    /// Constructor
+    /// \param[in] udp The socket to receive requests on. Must already be begun on the RADIUS port
+    /// \param[in] secret The secret shared with the clients
+    /// \param[in] handler The function called for each request
+    RadiusServer(UDP* udp, const char* secret, RadiusServerHandler handler);
+
+    /// Receive waiting requests and call the handler for each new one. Call regularly from loop()
+    /// \return The number of requests handed to the handler
+    uint8_t             poll();
+
+    /// Start the reply to a request, with the Proxy-States of the request
+    /// \param[in] slot The slot of the request, as passed to the handler
+    /// \param[in] code The RADIUS message type code of the reply
+    /// \return The reply, to add attributes to
+    RadiusMsg*          reply(uint8_t slot, RadiusCode code);
+
+    /// Sign and send the reply started by reply(), and free the slot of the request
+    /// \return true if sent
+    uint8_t             sendReply();
+
+    /// Drop a request without replying, and free its slot
+    /// \param[in] slot The slot of the request, as passed to the handler
+    void                drop(uint8_t slot);
+
+    /// Get the request in a slot, such as for a deferred reply
+    /// \param[in] slot The slot of the request, as passed to the handler
+    /// \return The request
+    RadiusMsg*          request(uint8_t slot);
+
+    /// Get the number of slots in use: requests queued or being handled
+    /// \return The number of slots in use
+    uint8_t             depth();
+};
+
+#endif
@@ -0,0 +1,279 @@
+// RadiusSimUDP.cpp
+//
+// Simulated UDP socket on an in-memory network, with a virtual clock, for testing
+//
+// $Id: $
+
+#include "RadiusSimUDP.h"
+
+unsigned long RadiusSimUDP::virtualTime = 0;
+
+RadiusSimUDP::RadiusSimUDP(IPAddress a)
+{
+  address = a;
+  port = 0;
+  peer = 0;
+  uint8_t i;
+  for (i = 0; i < RADIUS_SIM_QUEUE_SIZE; i++)
+    queue[i].state = RadiusSimFree;
+  current = -1;
+  readPosition = 0;
+  writing = -1;
+  latency = 0;
+  jitter = 0;
+  lossPercent = 0;
+  duplicatePercent = 0;
+  randomState = 1;
+  sent = 0;
+  lost = 0;
+  duplicated = 0;
+}
+
+void
+RadiusSimUDP::connect(RadiusSimUDP* p)
+{
+  peer = p;
+}
+
+void
+RadiusSimUDP::setLatency(unsigned long l, unsigned long j)
+{
+  latency = l;
+  jitter = j;
+}
+
+void
+RadiusSimUDP::setLoss(uint8_t percent)
+{
+  lossPercent = percent;
+}
+
+void
+RadiusSimUDP::setDuplication(uint8_t percent)
+{
+  duplicatePercent = percent;
+}
+
+void
+RadiusSimUDP::setSeed(uint32_t seed)
+{
+  randomState = seed ? seed : 1;
+}
+
+uint32_t
+RadiusSimUDP::randomNumber(uint32_t limit)
+{
+  // xorshift32: fast, and the same sequence on every platform
+  randomState ^= randomState << 13;
+  randomState ^= randomState >> 17;
+  randomState ^= randomState << 5;
+  return limit ? randomState % limit : 0;
+}
+
+unsigned long
+RadiusSimUDP::clock()
+{
+  return virtualTime;
+}
+
+void
+RadiusSimUDP::advance(unsigned long ms)
+{
+  virtualTime += ms;
+}
+
+void
+RadiusSimUDP::tick()
+{
+  virtualTime++;
+}
+
+int8_t
+RadiusSimUDP::freeDatagram()
+{
+  int8_t i;
+  for (i = 0; i < RADIUS_SIM_QUEUE_SIZE; i++)
+    if (queue[i].state == RadiusSimFree)
+      return i;
+  return -1;
+}
+
+uint8_t
+RadiusSimUDP::begin(uint16_t p)
+{
+  port = p;
+  return 1;
+}
+
+void
+RadiusSimUDP::stop()
+{
+  port = 0;
+  uint8_t i;
+  for (i = 0; i < RADIUS_SIM_QUEUE_SIZE; i++)
+    queue[i].state = RadiusSimFree;
+  current = -1;
+}
+
+int
+RadiusSimUDP::beginPacket(IPAddress ip, uint16_t p)
+{
+  if (writing >= 0)
+    peer->queue[writing].state = RadiusSimFree; // The previous packet was never ended
+  writing = -1;
+  // Only the peer is reachable
+  if (peer && peer->port && p == peer->port && ip == peer->address)
+    writing = peer->freeDatagram();
+  if (writing >= 0)
+  {
+    peer->queue[writing].state = RadiusSimWriting;
+    peer->queue[writing].length = 0;
+  }
+  return 1;
+}
+
+int
+RadiusSimUDP::beginPacket(const char* host, uint16_t p)
+{
+  (void)host;
+  (void)p;
+  return 0; // There are no names on the simulated network
+}
+
+size_t
+RadiusSimUDP::write(uint8_t c)
+{
+  return write(&c, 1);
+}
+
+size_t
+RadiusSimUDP::write(const uint8_t* buffer, size_t size)
+{
+  if (writing < 0)
+    return size; // Will be lost anyway
+  RadiusSimDatagram* d = &peer->queue[writing];
+  if (size > (size_t)(RADIUS_MAX_SIZE - d->length))
+    size = RADIUS_MAX_SIZE - d->length;
+  memcpy(d->data + d->length, buffer, size);
+  d->length += size;
+  return size;
+}
+
+int
+RadiusSimUDP::endPacket()
+{
+  sent++;
+  if (writing < 0)
+  {
+    lost++;
+    return 1; // UDP senders dont find out
+  }
+  RadiusSimDatagram* d = &peer->queue[writing];
+  writing = -1;
+  if (randomNumber(100) < lossPercent)
+  {
+    d->state = RadiusSimFree;
+    lost++;
+    return 1;
+  }
+  d->fromAddress = address;
+  d->fromPort = port;
+  d->deliverTime = virtualTime + latency + randomNumber(jitter + 1);
+  d->state = RadiusSimInFlight;
+
+  if (randomNumber(100) < duplicatePercent)
+  {
+    int8_t i = peer->freeDatagram();
+    if (i >= 0)
+    {
+      RadiusSimDatagram* copy = &peer->queue[i];
+      memcpy(copy->data, d->data, d->length);
+      copy->length = d->length;
+      copy->fromAddress = d->fromAddress;
+      copy->fromPort = d->fromPort;
+      copy->deliverTime = virtualTime + latency + randomNumber(jitter + 1);
+      copy->state = RadiusSimInFlight;
+      duplicated++;
+    }
+  }
+  return 1;
+}
+
+int
+RadiusSimUDP::parsePacket()
+{
+  // The previous datagram is discarded, read or not
+  if (current >= 0)
+    queue[current].state = RadiusSimFree;
+  current = -1;
+
+  // The earliest datagram that has arrived
+  int8_t i;
+  for (i = 0; i < RADIUS_SIM_QUEUE_SIZE; i++)
+  {
+    if (   queue[i].state == RadiusSimInFlight
+	&& (long)(virtualTime - queue[i].deliverTime) >= 0
+	&& (current < 0 || (long)(queue[i].deliverTime - queue[current].deliverTime) < 0))
+      current = i;
+  }
+  if (current < 0)
+    return 0;
+  queue[current].state = RadiusSimReading;
+  readPosition = 0;
+  return queue[current].length;
+}
+
+int
+RadiusSimUDP::available()
+{
+  return current >= 0 ? queue[current].length - readPosition : 0;
+}
+
+int
+RadiusSimUDP::read()
+{
+  uint8_t c;
+  return read(&c, 1) == 1 ? c : -1;
+}
+
+int
+RadiusSimUDP::read(unsigned char* buffer, size_t length)
+{
+  if (current < 0)
+    return -1;
+  size_t n = available();
+  if (n > length)
+    n = length;
+  memcpy(buffer, queue[current].data + readPosition, n);
+  readPosition += n;
+  return n;
+}
+
+int
+RadiusSimUDP::read(char* buffer, size_t length)
+{
+  return read((unsigned char*)buffer, length);
+}
+
+int
+RadiusSimUDP::peek()
+{
+  return available() ? queue[current].data[readPosition] : -1;
+}
+
+void
+RadiusSimUDP::flush()
+{
+}
+
+IPAddress
+RadiusSimUDP::remoteIP()
+{
+  return current >= 0 ? queue[current].fromAddress : IPAddress(0, 0, 0, 0);
+}
+
+uint16_t
+RadiusSimUDP::remotePort()
+{
+  return current >= 0 ? queue[current].fromPort : 0;
+}
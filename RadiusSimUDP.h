@@ -0,0 +1,195 @@
+// RadiusSimUDP.h
+//
+// Simulated UDP socket on an in-memory network, with a virtual clock, for testing
+//
+// $Id: $
+
+#ifndef _RADIUSSIMUDP_H_
+#define _RADIUSSIMUDP_H_
+
+#include "RadiusMsg.h"
+
+// Maximum number of datagrams in flight to each RadiusSimUDP. Each takes just over
+// RADIUS_MAX_SIZE octets of RAM
+#ifndef RADIUS_SIM_QUEUE_SIZE
+#define RADIUS_SIM_QUEUE_SIZE 4
+#endif
+
+// State of a RadiusSimDatagram
+typedef enum
+{
+    RadiusSimFree = 0,
+    RadiusSimWriting,
+    RadiusSimInFlight,
+    RadiusSimReading,
+} RadiusSimState;
+
+/////////////////////////////////////////////////////////////////////
+/// \struct RadiusSimDatagram
+/// A datagram on its way to a RadiusSimUDP, or being read from it
+typedef struct
+{
+    /// The contents of the datagram
+    uint8_t       data[RADIUS_MAX_SIZE];
+
+    /// Number of octets in data
+    uint16_t      length;
+
+    /// Address of the sender
+    IPAddress     fromAddress;
+
+    /// Port of the sender
+    uint16_t      fromPort;
+
+    /// Virtual time when the datagram arrives
+    unsigned long deliverTime;
+
+    /// One of RadiusSimState
+    uint8_t       state;
+
+} RadiusSimDatagram;
+
+/////////////////////////////////////////////////////////////////////
+/// \class RadiusSimUDP RadiusSimUDP.h <RadiusSimUDP.h>
+/// \brief Simulated UDP socket for testing retransmissions and timeouts in virtual time
+///
+/// A UDP socket that sends to another RadiusSimUDP through memory instead of a network,
+/// so RADIUS clients, servers and proxies can be tested without any network hardware.
+/// Each direction can be given a latency, a random jitter that reorders datagrams,
+/// and a percentage of datagrams lost and duplicated. The pseudo random choices are
+/// made from a seed, so every run with the same seed is the same.
+///
+/// Time is virtual: it only moves on when advance() or tick() is called. Use it for the
+/// library with RadiusMsg::setClock(RadiusSimUDP::clock), and in a blocking sendWaitReply()
+/// with RadiusMsg::setIdle(RadiusSimUDP::tick), so a 5 second timeout is 5000 ticks, which
+/// take a fraction of a millisecond. Thousands of retransmission and timeout scenarios
+/// can then be run in seconds, with reproducible timing.
+///
+/// Datagrams are only delivered to the connected peer, and only when they are sent to its
+/// address and the port it was begun on. Anything else is lost, as are datagrams
+/// sent when RADIUS_SIM_QUEUE_SIZE datagrams are already in flight to the peer.
+///
+/// Each RadiusSimUDP needs RADIUS_SIM_QUEUE_SIZE times RADIUS_MAX_SIZE octets of RAM,
+/// so on small boards use a small RADIUS_SIM_QUEUE_SIZE, or run the tests on the host.
+class RadiusSimUDP : public UDP
+{
+private:
+    /// The address of this socket
+    IPAddress         address;
+
+    /// The local port, or 0 if not begun
+    uint16_t          port;
+
+    /// Where datagrams are sent
+    RadiusSimUDP*     peer;
+
+    /// Datagrams in flight to this socket, and the one being read
+    RadiusSimDatagram queue[RADIUS_SIM_QUEUE_SIZE];
+
+    /// Index in queue of the datagram being read, or -1
+    int8_t            current;
+
+    /// Number of octets of the current datagram read so far
+    uint16_t          readPosition;
+
+    /// Index in the queue of the peer of the datagram being written, or -1 if it will be lost
+    int8_t            writing;
+
+    /// Minimum time for a datagram to reach the peer, in milliseconds
+    unsigned long     latency;
+
+    /// Maximum extra random time for a datagram to reach the peer, in milliseconds
+    unsigned long     jitter;
+
+    /// Percentage of datagrams lost
+    uint8_t           lossPercent;
+
+    /// Percentage of datagrams delivered twice
+    uint8_t           duplicatePercent;
+
+    /// State of the pseudo random number generator
+    uint32_t          randomState;
+
+    /// The virtual time
+    static unsigned long virtualTime;
+
+    /// Find a free datagram in the queue
+    /// \return Its index, or -1 if the queue is full
+    int8_t            freeDatagram();
+
+    /// Get a pseudo random number
+    /// \param[in] limit One more than the largest number wanted
+    /// \return A number from 0 to limit - 1
+    uint32_t          randomNumber(uint32_t limit);
+
+public:
+    /// Number of datagrams sent
+    uint32_t          sent;
+
+    /// Number of datagrams lost, because of the loss percentage, a full queue, or a wrong address
+    uint32_t          lost;
+
+    /// Number of extra copies of datagrams delivered
+    uint32_t          duplicated;
+
+    /// Constructor
+    /// \param[in] address The IP address of this socket, reported as the remoteIP() of
+    /// datagrams it sends
+    RadiusSimUDP(IPAddress address);
+
+    /// Connect to the socket datagrams are sent to. To send both ways, connect each
+    /// socket to the other
+    /// \param[in] peer The other socket
+    void              connect(RadiusSimUDP* peer);
+
+    /// Set how long datagrams sent from this socket take to arrive. Each takes latency plus a
+    /// random time up to jitter, so with jitter, datagrams can arrive out of order
+    /// \param[in] latency Minimum time in milliseconds
+    /// \param[in] jitter Maximum extra time in milliseconds
+    void              setLatency(unsigned long latency, unsigned long jitter = 0);
+
+    /// Set the percentage of datagrams sent from this socket that are lost
+    /// \param[in] percent 0 to 100
+    void              setLoss(uint8_t percent);
+
+    /// Set the percentage of datagrams sent from this socket that arrive twice, each copy
+    /// with its own latency
+    /// \param[in] percent 0 to 100
+    void              setDuplication(uint8_t percent);
+
+    /// Set the seed for the pseudo random loss, duplication and jitter
+    /// \param[in] seed Any number except 0
+    void              setSeed(uint32_t seed);
+
+    /// Get the virtual time. A RadiusClockFunction for RadiusMsg::setClock()
+    /// \return The virtual time in milliseconds
+    static unsigned long clock();
+
+    /// Move the virtual time on
+    /// \param[in] ms Number of milliseconds
+    static void       advance(unsigned long ms);
+
+    /// Move the virtual time on by a millisecond. A RadiusIdleFunction for RadiusMsg::setIdle()
+    static void       tick();
+
+    // The UDP interface
+    uint8_t           begin(uint16_t port);
+    void              stop();
+    int               beginPacket(IPAddress ip, uint16_t port);
+    int               beginPacket(const char* host, uint16_t port);
+    int               endPacket();
+    size_t            write(uint8_t c);
+    size_t            write(const uint8_t* buffer, size_t size);
+    using Print::write;
+    int               parsePacket();
+    int               available();
+    int               read();
+    int               read(unsigned char* buffer, size_t length);
+    int               read(char* buffer, size_t length);
+    int               peek();
+    void              flush();
+    IPAddress         remoteIP();
+    uint16_t          remotePort();
+};
+
+#endif
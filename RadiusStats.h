@@ -0,0 +1,104 @@
+// RadiusStats.h
+//
+// Counters and latency histogram for RADIUS requests sent to a server
+//
+// $Id: $
+
+#ifndef _RADIUSSTATS_H_
+#define _RADIUSSTATS_H_
+
+#if ARDUINO >= 100
+#include <Arduino.h>
+#else
+#include <wiring.h>
+#endif
+
+// Number of linear sub-buckets for each power of 2 milliseconds in the latency histogram.
+// Must be a power of 2. Larger values give more precise percentiles but use more RAM
+#define RADIUS_STATS_SUB_BUCKETS 4
+// Number of buckets in the latency histogram. The last bucket holds all latencies 
+// too large for the others
+#define RADIUS_STATS_BUCKETS (16 * RADIUS_STATS_SUB_BUCKETS)
+// Requests are counted by RADIUS code for codes below this. Requests with other codes
+// are counted in requestsByCode[0]
+#define RADIUS_STATS_CODES 14
+
+/////////////////////////////////////////////////////////////////////
+/// \class RadiusStats RadiusStats.h <RadiusStats.h>
+/// \brief Class to count RADIUS requests, replies and failures for one RADIUS server
+///
+/// Use one instance for each RADIUS server, and connect it to the requests sent to that server 
+/// with RadiusMsg::setStats(). RadiusMsg::sendWaitReply() and 
+/// RadiusMsg::checkAuthenticatorsWithOriginal() then update the counters and record the latency 
+/// of each reply in a log-linear histogram: each power of 2 milliseconds is divided into
+/// RADIUS_STATS_SUB_BUCKETS equal buckets, so percentiles are accurate to within 25% with 
+/// the default settings. Updating the statistics is a few increments, with no locking.
+///
+/// The counters can be read directly, or copied with snapshot() so that they can be reported
+/// while requests continue to be counted.
+class RadiusStats
+{
+public:
+    /// Number of requests sent, not counting retransmissions
+    uint32_t requests;
+
+    /// Number of requests sent, not counting retransmissions, indexed by RADIUS code
+    uint32_t requestsByCode[RADIUS_STATS_CODES];
+
+    /// Number of matching replies received
+    uint32_t replies;
+
+    /// Number of retransmissions
+    uint32_t retransmits;
+
+    /// Number of requests that got no reply after all retries
+    uint32_t timeouts;
+
+    /// Number of replies with an incorrect authenticator
+    uint32_t badAuthenticators;
+
+    /// Number of received packets that were discarded because they were not RADIUS packets 
+    /// or did not match the request
+    uint32_t discarded;
+
+    /// Number of replies received in each latency bucket
+    uint32_t latency[RADIUS_STATS_BUCKETS];
+
+    /// Sum of the latencies of all replies in milliseconds
+    uint32_t latencySum;
+
+    /// Constructor. All counters are initially 0
+    RadiusStats();
+
+    /// Set all counters and the histogram to 0
+    void          reset();
+
+    /// Count a request sent for the first time
+    /// \param[in] code The RADIUS code of the request
+    void          recordRequest(uint8_t code);
+
+    /// Record the latency of a reply in the histogram
+    /// \param[in] ms Time from the first transmission of the request to the reply in milliseconds
+    void          recordLatency(unsigned long ms);
+
+    /// Copy the counters and histogram, so they can be reported while they continue to change
+    /// \param[out] copy Destination for the copy
+    void          snapshot(RadiusStats* copy);
+
+    /// Estimate a latency percentile from the histogram
+    /// \param[in] percent The percentile wanted, 0 to 100
+    /// \return The lowest latency in milliseconds of the bucket containing the percentile
+    unsigned long percentile(uint8_t percent);
+
+    /// Compute the histogram bucket for a latency
+    /// \param[in] ms Latency in milliseconds
+    /// \return Index into latency[]
+    static uint8_t       bucket(unsigned long ms);
+
+    /// Compute the lowest latency represented by a histogram bucket
+    /// \param[in] bucket Index into latency[]
+    /// \return Latency in milliseconds
+    static unsigned long bucketLatency(uint8_t bucket);
+};
+
+#endif
@@ -0,0 +1,280 @@
+// RadiusTcpClient.cpp
+//
+// RADIUS client over a persistent TCP connection (RFC 6613)
+//
+// $Id: $
+
+#include "RadiusTcpClient.h"
+
+RadiusTcpClient::RadiusTcpClient(Client* c, IPAddress s, uint16_t p)
+{
+  client = c;
+  server = s;
+  port = p;
+  uint8_t i;
+  for (i = 0; i < RADIUS_TCP_MAX_PENDING; i++)
+    pending[i].status = RadiusTcpStatusFree;
+  received = 0;
+  length = 0;
+  match = -1;
+  lastConnectTime = 0;
+  connectTried = false;
+  writeBuffer = 0;
+  writeBufferSize = 0;
+  writeLength = 0;
+  connects = 0;
+  discarded = 0;
+}
+
+uint8_t
+RadiusTcpClient::connect()
+{
+  client->stop();
+  // Any partly received reply and any unwritten requests are lost with the old connection
+  received = 0;
+  writeLength = 0;
+  lastConnectTime = RadiusMsg::now();
+  connectTried = true;
+  if (!client->connect(server, port))
+    return false;
+  connects++;
+
+  // Send the queued requests, and those sent on the old connection, whose replies will 
+  // never arrive on this one
+  uint8_t i;
+  for (i = 0; i < RADIUS_TCP_MAX_PENDING; i++)
+  {
+    if (pending[i].status == RadiusTcpStatusPending)
+    {
+      if (!write(pending[i].request))
+	return false;
+      if (pending[i].written && pending[i].request->stats)
+	pending[i].request->stats->retransmits++;
+      pending[i].written = true;
+    }
+  }
+  return flush();
+}
+
+uint8_t
+RadiusTcpClient::write(RadiusMsg* request)
+{
+  if (writeLength + request->packetLength > writeBufferSize && !flush())
+    return false;
+  if (request->packetLength > writeBufferSize)
+    return client->write((const uint8_t*)&request->packet, request->packetLength) == request->packetLength;
+  memcpy(writeBuffer + writeLength, &request->packet, request->packetLength);
+  writeLength += request->packetLength;
+  return true;
+}
+
+void
+RadiusTcpClient::setWriteBuffer(uint8_t* buffer, uint16_t size)
+{
+  flush();
+  writeBuffer = buffer;
+  writeBufferSize = buffer ? size : 0;
+}
+
+uint8_t
+RadiusTcpClient::flush()
+{
+  if (!writeLength)
+    return true;
+  uint8_t ret = client->write(writeBuffer, writeLength) == writeLength;
+  writeLength = 0;
+  return ret;
+}
+
+int8_t
+RadiusTcpClient::send(RadiusMsg* request, RadiusMsg* reply, RadiusTcpCallback callback, void* context)
+{
+  int8_t free = -1;
+  uint8_t i;
+  for (i = 0; i < RADIUS_TCP_MAX_PENDING; i++)
+  {
+    if (pending[i].status == RadiusTcpStatusFree)
+    {
+      if (free < 0)
+	free = i;
+    }
+    else if (pending[i].status == RadiusTcpStatusPending
+	     && pending[i].request->packet.identifier == request->packet.identifier)
+      return -1; // Replies could not be told apart
+  }
+  if (free < 0)
+    return -1; // Table full
+
+  // Without a connection, the request waits for poll() to connect
+  uint8_t connected = client->connected();
+  if (connected && !write(request))
+    return -1;
+
+  pending[free].written = connected;
+  pending[free].request = request;
+  pending[free].reply = reply;
+  pending[free].sendTime = RadiusMsg::now();
+  pending[free].callback = callback;
+  pending[free].context = context;
+  pending[free].status = RadiusTcpStatusPending;
+  if (request->stats)
+    request->stats->recordRequest(request->packet.code);
+  return free;
+}
+
+void
+RadiusTcpClient::readReplies()
+{
+  while (client->available() > 0)
+  {
+    if (received < sizeof(header))
+    {
+      int c = client->read();
+      if (c < 0)
+	break;
+      header[received++] = c;
+      if (received < sizeof(header))
+	continue;
+
+      length = (uint16_t)header[2] << 8 | header[3];
+      if (length < RADIUS_HEADER_LENGTH || length > RADIUS_MAX_SIZE)
+      {
+	// Cant find the start of the next packet, so the connection is useless (RFC 6613 2.6.4)
+	stop();
+	return;
+      }
+      // Find the request this reply is for, and receive straight into its reply
+      match = -1;
+      uint8_t i;
+      for (i = 0; i < RADIUS_TCP_MAX_PENDING; i++)
+      {
+	if (pending[i].status == RadiusTcpStatusPending
+	    && pending[i].request->packet.identifier == header[1])
+	{
+	  match = i;
+	  memcpy(&pending[i].reply->packet, header, sizeof(header));
+	  break;
+	}
+      }
+      continue;
+    }
+
+    // The rest of the packet
+    int got;
+    if (match >= 0)
+    {
+      got = client->read((uint8_t*)&pending[match].reply->packet + received, length - received);
+    }
+    else
+    {
+      uint8_t scratch[16];
+      got = client->read(scratch, length - received < (uint16_t)sizeof(scratch) ? length - received : sizeof(scratch));
+    }
+    if (got <= 0)
+      break;
+    received += got;
+    if (received < length)
+      continue;
+
+    // Complete
+    received = 0;
+    if (match < 0 || pending[match].status != RadiusTcpStatusPending)
+    {
+      discarded++; // No request, or it timed out while the reply was arriving
+      continue;
+    }
+    RadiusTcpPending* p = &pending[match];
+    p->reply->packetLength = length;
+    p->reply->peerAddress = server;
+    p->reply->peerPort = port;
+    if (p->request->stats)
+    {
+      p->request->stats->replies++;
+      p->request->stats->recordLatency(RadiusMsg::now() - p->sendTime);
+    }
+    complete(match, RadiusTcpStatusReplied);
+  }
+}
+
+void
+RadiusTcpClient::complete(int8_t handle, uint8_t status)
+{
+  RadiusTcpPending* p = &pending[handle];
+  p->status = status;
+  if (p->callback)
+    p->callback(this, handle, status, p->context);
+}
+
+void
+RadiusTcpClient::poll()
+{
+  uint8_t outstanding = false;
+  uint8_t i;
+  for (i = 0; i < RADIUS_TCP_MAX_PENDING; i++)
+  {
+    RadiusTcpPending* p = &pending[i];
+    if (p->status != RadiusTcpStatusPending)
+      continue;
+    if (RadiusMsg::now() - p->sendTime >= 1000UL * p->request->timeout)
+    {
+      if (p->request->stats)
+	p->request->stats->timeouts++;
+      complete(i, RadiusTcpStatusTimeout);
+    }
+    else
+      outstanding = true;
+  }
+
+  if (client->connected())
+  {
+    if (!flush())
+      stop(); // Requests will be sent again on a new connection
+    readReplies();
+  }
+  else if (   outstanding
+	   && (!connectTried || RadiusMsg::now() - lastConnectTime >= RADIUS_TCP_RECONNECT_INTERVAL))
+    connect();
+}
+
+uint8_t
+RadiusTcpClient::status(int8_t handle)
+{
+  if (handle < 0 || handle >= RADIUS_TCP_MAX_PENDING)
+    return RadiusTcpStatusFree;
+  return pending[handle].status;
+}
+
+void
+RadiusTcpClient::release(int8_t handle)
+{
+  if (handle < 0 || handle >= RADIUS_TCP_MAX_PENDING)
+    return;
+  // A reply still to arrive for this request will be discarded
+  if (match == handle && received >= sizeof(header))
+    match = -1;
+  pending[handle].status = RadiusTcpStatusFree;
+}
+
+uint8_t
+RadiusTcpClient::sendWaitReply(RadiusMsg* request, RadiusMsg* reply)
+{
+  int8_t handle = send(request, reply);
+  if (handle < 0)
+    return false;
+  while (status(handle) == RadiusTcpStatusPending)
+  {
+    poll();
+    RadiusMsg::idle();
+  }
+  uint8_t ret = status(handle) == RadiusTcpStatusReplied;
+  release(handle);
+  return ret;
+}
+
+void
+RadiusTcpClient::stop()
+{
+  client->stop();
+  received = 0;
+  writeLength = 0;
+}
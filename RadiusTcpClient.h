@@ -0,0 +1,230 @@
+// RadiusTcpClient.h
+//
+// RADIUS client over a persistent TCP connection (RFC 6613)
+//
+// $Id: $
+
+#ifndef _RADIUSTCPCLIENT_H_
+#define _RADIUSTCPCLIENT_H_
+
+#include <Client.h>
+#include "RadiusMsg.h"
+
+// Maximum number of requests outstanding on the connection at once
+#define RADIUS_TCP_MAX_PENDING 8
+// Minimum time between attempts to reconnect to the server, in milliseconds
+#define RADIUS_TCP_RECONNECT_INTERVAL 1000
+// The shared secret and TCP port for RADIUS over TLS (RFC 6614)
+#define RADIUS_RADSEC_SECRET "radsec"
+#define RADIUS_RADSEC_PORT 2083
+
+// Status of a request sent with RadiusTcpClient::send()
+typedef enum
+{
+    RadiusTcpStatusFree = 0,
+    RadiusTcpStatusPending,
+    RadiusTcpStatusReplied,
+    RadiusTcpStatusTimeout,
+} RadiusTcpStatus;
+
+class RadiusTcpClient;
+
+/// Function called when a request sent with RadiusTcpClient::send() completes, from within
+/// RadiusTcpClient::poll(). It may release() the request and send() new ones.
+/// \param[in] client The client the request was sent with
+/// \param[in] handle The handle returned by send()
+/// \param[in] status RadiusTcpStatusReplied or RadiusTcpStatusTimeout
+/// \param[in] context The context passed to send()
+typedef void (*RadiusTcpCallback)(RadiusTcpClient* client, int8_t handle, uint8_t status, void* context);
+
+/////////////////////////////////////////////////////////////////////
+/// \struct RadiusTcpPending
+/// A request sent over the connection, and where its reply goes
+typedef struct
+{
+    /// The request. Kept so it can be sent again on a new connection
+    RadiusMsg*        request;
+
+    /// Where the reply is received
+    RadiusMsg*        reply;
+
+    /// RadiusMsg::now() when the request was sent or queued
+    unsigned long     sendTime;
+
+    /// Called when the request completes, if set
+    RadiusTcpCallback callback;
+
+    /// Passed to callback
+    void*             context;
+
+    /// One of RadiusTcpStatus
+    uint8_t           status;
+
+    /// true once the request has been written to a connection
+    uint8_t           written;
+
+} RadiusTcpPending;
+
+/////////////////////////////////////////////////////////////////////
+/// \class RadiusTcpClient RadiusTcpClient.h <RadiusTcpClient.h>
+/// \brief Class to send RADIUS requests and receive replies over TCP
+///
+/// Sends RADIUS requests over one long-lived TCP connection to a RADIUS server, as described
+/// in RFC 6613, instead of over UDP. Up to RADIUS_TCP_MAX_PENDING requests, each with a
+/// different identifier, can be outstanding on the connection at once.
+/// TCP already retransmits lost segments, so requests are not retransmitted at the RADIUS
+/// layer, which avoids the retransmission delays of RADIUS over UDP on lossy links.
+///
+/// The stream is framed by the length field of each RADIUS header: replies are read
+/// directly into the reply RadiusMsg of the matching request, without an intermediate buffer.
+/// A reply with an impossible length means the stream can no longer be framed, and the
+/// connection is closed.
+///
+/// The connection is opened by poll() when there are requests to send. send() does not
+/// connect: while there is no connection, requests are queued, and written when the
+/// connection is up. If the connection is lost, it is reopened automatically, no more 
+/// often than every RADIUS_TCP_RECONNECT_INTERVAL milliseconds, and all outstanding 
+/// requests are sent again on the new connection. Arduino Clients have no non-blocking 
+/// connect, so the poll() that connects blocks until the connection is up or the Client 
+/// gives up, for up to a few seconds for an unreachable server. Shorten that where the
+/// Client allows, such as with EthernetClient::setConnectionTimeout().
+///
+/// Works with any Arduino Client, such as EthernetClient or WiFiClient.
+///
+/// For RadSec (RADIUS over TLS, RFC 6614), use a TLS Client such as WiFiClientSecure or 
+/// SSLClient, port RADIUS_RADSEC_PORT, and sign requests and check replies with the fixed 
+/// secret RADIUS_RADSEC_SECRET. Each reconnection costs a full TLS handshake.
+/// Each write to a TLS Client costs a TLS record, so give it a buffer with setWriteBuffer(): 
+/// requests are then coalesced and written together in as few records as possible, 
+/// when the buffer is full or on the next poll().
+///
+/// There are no threads: call poll() regularly from loop(), or use the blocking sendWaitReply().
+/// The completion of a request can be found by checking status() after each poll(), or by
+/// passing a callback to send(), which is called from poll() when the reply arrives or the
+/// request times out. With callbacks, a sequence of requests can be written as a chain of 
+/// callbacks, each sending the next request, while loop() carries on with other work.
+/// Requests must be signed before sending, and replies checked with
+/// RadiusMsg::checkAuthenticatorsWithOriginal() as usual. The timeout of each request,
+/// and its RadiusStats if any, are taken from the request.
+class RadiusTcpClient
+{
+private:
+    /// The TCP connection
+    Client*          client;
+
+    /// Address of the RADIUS server
+    IPAddress        server;
+
+    /// TCP port of the RADIUS server
+    uint16_t         port;
+
+    /// The outstanding requests
+    RadiusTcpPending pending[RADIUS_TCP_MAX_PENDING];
+
+    /// The first 4 octets of the RADIUS header of the reply being received: code,
+    /// identifier and length
+    uint8_t          header[4];
+
+    /// Number of octets of the reply being received so far
+    uint16_t         received;
+
+    /// Length of the reply being received, from its header
+    uint16_t         length;
+
+    /// Index in pending of the request the reply being received is for, or -1 if
+    /// it matches no request and is being discarded
+    int8_t           match;
+
+    /// RadiusMsg::now() at the last attempt to connect
+    unsigned long    lastConnectTime;
+
+    /// true once a connection has been attempted
+    uint8_t          connectTried;
+
+    /// Where requests are coalesced before writing, if anywhere
+    uint8_t*         writeBuffer;
+
+    /// Size of writeBuffer in octets
+    uint16_t         writeBufferSize;
+
+    /// Number of octets waiting in writeBuffer
+    uint16_t         writeLength;
+
+    /// Open a new connection, and send all the outstanding requests on it
+    /// \return true if connected
+    uint8_t          connect();
+
+    /// Write a request to the connection, or to the write buffer if there is one
+    /// \return true if all of it was written
+    uint8_t          write(RadiusMsg* request);
+
+    /// Read and complete as many replies as are available
+    void             readReplies();
+
+    /// Set the final status of a request and call its callback
+    /// \param[in] handle Index in pending of the request
+    /// \param[in] status RadiusTcpStatusReplied or RadiusTcpStatusTimeout
+    void             complete(int8_t handle, uint8_t status);
+
+public:
+    /// Number of times a connection has been opened
+    uint32_t         connects;
+
+    /// Number of replies that matched no outstanding request
+    uint32_t         discarded;
+
+    /// Constructor
+    /// \param[in] client The client used for the TCP connection, such as an EthernetClient
+    /// \param[in] server The IP address of the RADIUS server
+    /// \param[in] port The TCP port of the RADIUS server. RFC 6613 uses the same ports as UDP
+    RadiusTcpClient(Client* client, IPAddress server, uint16_t port = 1812);
+
+    /// Send a signed request, without waiting for the reply. If there is no connection,
+    /// the request is queued, and sent when poll() has connected.
+    /// \param[in] request The request. Must remain valid until released
+    /// \param[in] reply Where to receive the reply. Must remain valid until released
+    /// \param[in] callback Function to call from poll() when the reply arrives or the request 
+    /// times out, if any
+    /// \param[in] context Passed to callback
+    /// \return A handle for status() and release(), or -1 if there are already
+    /// RADIUS_TCP_MAX_PENDING requests outstanding, another outstanding request has the same
+    /// identifier, or the request could not be sent
+    int8_t           send(RadiusMsg* request, RadiusMsg* reply, RadiusTcpCallback callback = 0, void* context = 0);
+
+    /// Receive any available replies, time out requests, connect if there are requests to send,
+    /// and call the callbacks of requests that complete. Call regularly from loop(). 
+    /// Blocks while connecting
+    void             poll();
+
+    /// Coalesce requests in a buffer and write them together, instead of writing each request
+    /// as soon as it is sent. Worthwhile when each write is expensive, such as for TLS.
+    /// \param[in] buffer The buffer. Must remain valid while the client is used. 
+    /// A TLS record holds up to 16384 octets, but a few hundred octets already 
+    /// save most of the records
+    /// \param[in] size Size of the buffer in octets
+    void             setWriteBuffer(uint8_t* buffer, uint16_t size);
+
+    /// Write any requests waiting in the write buffer. Called by poll()
+    /// \return true if they were all written
+    uint8_t          flush();
+
+    /// Get the status of a request sent with send()
+    /// \param[in] handle The handle returned by send()
+    /// \return One of RadiusTcpStatus
+    uint8_t          status(int8_t handle);
+
+    /// Forget a request sent with send(), when it is no longer pending or is no longer wanted
+    /// \param[in] handle The handle returned by send()
+    void             release(int8_t handle);
+
+    /// Send a signed request and block until the reply is received or the request times out.
+    /// \param[in] request The request
+    /// \param[in] reply Where to receive the reply
+    /// \return true if a reply was received
+    uint8_t          sendWaitReply(RadiusMsg* request, RadiusMsg* reply);
+
+    /// Close the connection. Outstanding requests will be sent again when it is reopened
+    void             stop();
+};
+
+#endif
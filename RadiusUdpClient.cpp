@@ -0,0 +1,174 @@
+// RadiusUdpClient.cpp
+//
+// Non-blocking RADIUS client over UDP, with several requests outstanding at once
+//
+// $Id: $
+
+#include "RadiusUdpClient.h"
+
+RadiusUdpClient::RadiusUdpClient(UDP* u, IPAddress s, uint16_t p)
+{
+  udp = u;
+  server = s;
+  port = p;
+  uint8_t i;
+  for (i = 0; i < RADIUS_UDP_MAX_PENDING; i++)
+    pending[i].status = RadiusUdpStatusFree;
+  discarded = 0;
+}
+
+int8_t
+RadiusUdpClient::begin(RadiusMsg* request, RadiusMsg* reply, RadiusUdpCallback callback, void* context)
+{
+  int8_t free = -1;
+  uint8_t i;
+  for (i = 0; i < RADIUS_UDP_MAX_PENDING; i++)
+  {
+    if (pending[i].status == RadiusUdpStatusFree)
+    {
+      if (free < 0)
+	free = i;
+    }
+    else if (pending[i].status == RadiusUdpStatusPending
+	     && pending[i].request->packet.identifier == request->packet.identifier)
+      return -1; // Replies could not be told apart
+  }
+  if (free < 0)
+    return -1; // Table full
+
+  if (request->sendto(udp, server, port) <= 0)
+    return -1;
+
+  RadiusUdpPending* p = &pending[free];
+  p->request = request;
+  p->reply = reply;
+  p->firstSendTime = p->sendTime = RadiusMsg::now();
+  p->callback = callback;
+  p->context = context;
+  p->tries = 1;
+  p->status = RadiusUdpStatusPending;
+  if (request->stats)
+    request->stats->recordRequest(request->packet.code);
+  return free;
+}
+
+void
+RadiusUdpClient::readReplies()
+{
+  uint8_t received;
+  for (received = 0; received < RADIUS_UDP_BURST && udp->parsePacket(); received++)
+  {
+    // Receive into the reply of any pending request: until that request is replied to,
+    // its reply is free to use. Then move it to the request it matches, if that is another one
+    int8_t into = -1;
+    uint8_t i;
+    for (i = 0; i < RADIUS_UDP_MAX_PENDING && into < 0; i++)
+      if (pending[i].status == RadiusUdpStatusPending)
+	into = i;
+    // Check the sender before reading anything
+    if (   into < 0
+	|| udp->remotePort() != port
+	|| !(udp->remoteIP() == server))
+    {
+      discarded++;
+      continue; // The next parsePacket() discards it
+    }
+    RadiusMsg* msg = pending[into].reply;
+    if (!msg->recv(udp, msg))
+    {
+      discarded++;
+      continue;
+    }
+
+    int8_t match = -1;
+    for (i = 0; i < RADIUS_UDP_MAX_PENDING && match < 0; i++)
+      if (   pending[i].status == RadiusUdpStatusPending
+	  && pending[i].request->packet.identifier == msg->packet.identifier)
+	match = i;
+    if (match < 0)
+    {
+      discarded++;
+      if (pending[into].request->stats)
+	pending[into].request->stats->discarded++;
+      continue;
+    }
+    RadiusUdpPending* p = &pending[match];
+    if (match != into)
+    {
+      memcpy(&p->reply->packet, &msg->packet, msg->packetLength);
+      p->reply->packetLength = msg->packetLength;
+      p->reply->peerAddress = msg->peerAddress;
+      p->reply->peerPort = msg->peerPort;
+    }
+    if (p->request->stats)
+    {
+      p->request->stats->replies++;
+      p->request->stats->recordLatency(RadiusMsg::now() - p->firstSendTime);
+    }
+    complete(match, RadiusUdpStatusReplied);
+  }
+}
+
+void
+RadiusUdpClient::complete(int8_t handle, uint8_t status)
+{
+  RadiusUdpPending* p = &pending[handle];
+  p->status = status;
+  if (p->callback)
+    p->callback(this, handle, status, p->context);
+}
+
+void
+RadiusUdpClient::poll()
+{
+  readReplies();
+
+  uint8_t i;
+  for (i = 0; i < RADIUS_UDP_MAX_PENDING; i++)
+  {
+    RadiusUdpPending* p = &pending[i];
+    if (   p->status != RadiusUdpStatusPending
+	|| RadiusMsg::now() - p->sendTime < 1000UL * p->request->timeout)
+      continue;
+    if (   p->tries < p->request->retries
+	&& p->request->sendto(udp, server, port) > 0)
+    {
+      p->sendTime = RadiusMsg::now();
+      p->tries++;
+      if (p->request->stats)
+	p->request->stats->retransmits++;
+      continue;
+    }
+    // Out of retries, or the send failed
+    if (p->request->stats)
+      p->request->stats->timeouts++;
+    complete(i, RadiusUdpStatusTimeout);
+  }
+}
+
+uint8_t
+RadiusUdpClient::status(int8_t handle)
+{
+  if (handle < 0 || handle >= RADIUS_UDP_MAX_PENDING)
+    return RadiusUdpStatusFree;
+  return pending[handle].status;
+}
+
+void
+RadiusUdpClient::release(int8_t handle)
+{
+  if (handle < 0 || handle >= RADIUS_UDP_MAX_PENDING)
+    return;
+  pending[handle].status = RadiusUdpStatusFree;
+}
+
+uint8_t
+RadiusUdpClient::outstanding()
+{
+  uint8_t n = 0;
+  uint8_t i;
+  for (i = 0; i < RADIUS_UDP_MAX_PENDING; i++)
+    if (pending[i].status == RadiusUdpStatusPending)
+      n++;
+  return n;
+}
@@ -0,0 +1,154 @@
+// RadiusUdpClient.h
+//
+// Non-blocking RADIUS client over UDP, with several requests outstanding at once
+//
+// $Id: $
+
+#ifndef _RADIUSUDPCLIENT_H_
+#define _RADIUSUDPCLIENT_H_
+
+#include "RadiusMsg.h"
+
+// Maximum number of requests outstanding at once
+#define RADIUS_UDP_MAX_PENDING 8
+// Maximum number of datagrams received in one poll(), so a flood cant keep poll() from 
+// returning to loop()
+#ifndef RADIUS_UDP_BURST
+#define RADIUS_UDP_BURST RADIUS_UDP_MAX_PENDING
+#endif
+
+// Status of a request sent with RadiusUdpClient::begin()
+typedef enum
+{
+    RadiusUdpStatusFree = 0,
+    RadiusUdpStatusPending,
+    RadiusUdpStatusReplied,
+    RadiusUdpStatusTimeout,
+} RadiusUdpStatus;
+
+class RadiusUdpClient;
+
+/// Function called when a request sent with RadiusUdpClient::begin() completes, from within
+/// RadiusUdpClient::poll(). It may release() the request and begin() new ones.
+/// \param[in] client The client the request was sent with
+/// \param[in] handle The handle returned by begin()
+/// \param[in] status RadiusUdpStatusReplied or RadiusUdpStatusTimeout
+/// \param[in] context The context passed to begin()
+typedef void (*RadiusUdpCallback)(RadiusUdpClient* client, int8_t handle, uint8_t status, void* context);
+
+/////////////////////////////////////////////////////////////////////
+/// \struct RadiusUdpPending
+/// A request sent to the server, and where its reply goes
+typedef struct
+{
+    /// The request. Kept so it can be retransmitted
+    RadiusMsg*        request;
+
+    /// Where the reply is received
+    RadiusMsg*        reply;
+
+    /// RadiusMsg::now() when the request was first sent
+    unsigned long     firstSendTime;
+
+    /// RadiusMsg::now() when the request was last sent
+    unsigned long     sendTime;
+
+    /// Called when the request completes, if set
+    RadiusUdpCallback callback;
+
+    /// Passed to callback
+    void*             context;
+
+    /// Number of times the request has been sent
+    uint8_t           tries;
+
+    /// One of RadiusUdpStatus
+    uint8_t           status;
+
+} RadiusUdpPending;
+
+/////////////////////////////////////////////////////////////////////
+/// \class RadiusUdpClient RadiusUdpClient.h <RadiusUdpClient.h>
+/// \brief Class to send RADIUS requests over UDP without blocking
+///
+/// RadiusMsg::sendWaitReply() blocks until the reply arrives or all the retries have timed out,
+/// by default up to 15 seconds, during which loop() does nothing else.
+/// RadiusUdpClient does the same work a step at a time instead: begin() sends a request
+/// and returns at once, and poll(), called regularly from loop(), receives replies,
+/// retransmits requests that have not been answered within their timeout, and gives up on
+/// them after their retries. Up to RADIUS_UDP_MAX_PENDING requests, each with a different
+/// identifier, can be outstanding at once. There are no threads and nothing is allocated:
+/// the requests and replies are RadiusMsgs provided by the caller.
+///
+/// The completion of a request can be found by checking status() after each poll(), or by
+/// passing a callback to begin(), which is called from poll() when the reply arrives or the
+/// request times out. Either way, release() the request when done with it.
+///
+/// Requests must be signed before sending, and replies checked with
+/// RadiusMsg::checkAuthenticatorsWithOriginal() as usual. The timeout and retries of each
+/// request, and its RadiusStats if any, are taken from the request.
+/// The UDP socket must be used only by this client, as poll() reads everything
+/// that arrives on it. Works with any Arduino UDP socket, such as EthernetUDP or WiFiUDP.
+class RadiusUdpClient
+{
+private:
+    /// The socket requests are sent and replies received on
+    UDP*             udp;
+
+    /// Address of the RADIUS server
+    IPAddress        server;
+
+    /// UDP port of the RADIUS server
+    uint16_t         port;
+
+    /// The outstanding requests
+    RadiusUdpPending pending[RADIUS_UDP_MAX_PENDING];
+
+    /// Receive and complete the replies that are available, up to RADIUS_UDP_BURST datagrams
+    void             readReplies();
+
+    /// Set the final status of a request and call its callback
+    /// \param[in] handle Index in pending of the request
+    /// \param[in] status RadiusUdpStatusReplied or RadiusUdpStatusTimeout
+    void             complete(int8_t handle, uint8_t status);
+
+public:
+    /// Number of datagrams received that matched no outstanding request
+    uint32_t         discarded;
+
+    /// Constructor
+    /// \param[in] udp The socket to send requests and receive replies on. Must already be begun
+    /// \param[in] server The IP address of the RADIUS server
+    /// \param[in] port The UDP port of the RADIUS server
+    RadiusUdpClient(UDP* udp, IPAddress server, uint16_t port = 1812);
+
+    /// Send a signed request, without waiting for the reply
+    /// \param[in] request The request. Must remain valid until released
+    /// \param[in] reply Where to receive the reply. Must remain valid until released
+    /// \param[in] callback Function to call from poll() when the reply arrives or the request
+    /// times out, if any
+    /// \param[in] context Passed to callback
+    /// \return A handle for status() and release(), or -1 if there are already
+    /// RADIUS_UDP_MAX_PENDING requests outstanding, another outstanding request has the same
+    /// identifier, or the request could not be sent
+    int8_t           begin(RadiusMsg* request, RadiusMsg* reply, RadiusUdpCallback callback = 0, void* context = 0);
+
+    /// Receive any available replies, retransmit and time out requests, and call
+    /// the callbacks of requests that complete. Call regularly from loop()
+    void             poll();
+
+    /// Get the status of a request sent with begin()
+    /// \param[in] handle The handle returned by begin()
+    /// \return One of RadiusUdpStatus
+    uint8_t          status(int8_t handle);
+
+    /// Forget a request sent with begin(), when it is no longer pending or is no longer wanted
+    /// \param[in] handle The handle returned by begin()
+    void             release(int8_t handle);
+
+    /// Get the number of requests still waiting for a reply
+    /// \return The number of requests with status RadiusUdpStatusPending
+    uint8_t          outstanding();
+};
+
+#endif
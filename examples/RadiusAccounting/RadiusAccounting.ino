@@ -0,0 +1,113 @@
+// RadiusAccounting.ino
+//
+// Sample RADIUS accounting client for a NAS using the Radius library for ArduinoMega and
+// Ethernet Shield.
+// Starts an accounting session for each of 4 ports, counts some made up traffic on each, and
+// sends an Accounting Start for each session, then Interim-Updates every 60 seconds.
+// The interim updates of the sessions are spread out over the interval, instead of all
+// being sent together. Requests are sent with a RadiusUdpClient, so loop() never blocks.
+//
+// $Id: $
+
+// Prevent compile complaints with some versi0ns of arduino:
+#undef abs
+#include <stdlib.h>
+
+#include <SPI.h>         // needed for Arduino versions later than 0018
+#include <Ethernet.h>
+#include <EthernetUdp.h>
+#include <RadiusMsg.h>
+#include <RadiusUdpClient.h>
+#include <RadiusAcctSessions.h>
+
+// This is the MAC address that your Ethernet shield will use
+// Configure to suit your needs
+byte mac[] = { 0xDE, 0xAD, 0xBE, 0xEF, 0xFE, 0xED };
+// Configure IP to be a suitable address for your network
+IPAddress ip = { 192, 168, 20, 25};
+// Configure server to be the IP address of your RADIUS server
+IPAddress server = { 192, 168, 20, 254 };
+// Configure gateway to be the IP address of your gateway router
+IPAddress gateway = { 192, 168, 20, 254 };
+unsigned int localPort = 8888;      // local port to listen on
+unsigned int serverPort = 1813;      // RADIUS accounting port on the server
+
+const char* secret = "testing123";
+const uint8_t ports = 4;
+
+EthernetUDP Udp;
+RadiusUdpClient radius(&Udp, server, serverPort);
+RadiusAcctSessions sessions(60);
+RadiusAcctSession* portSession[ports];
+uint8_t startSent = 0;  // Number of ports whose Accounting Start has been sent
+
+// The request being sent, and its reply
+RadiusMsg msg;
+RadiusMsg reply;
+int8_t handle = -1;
+
+// Send an accounting request for a session
+void sendAcct(RadiusAcctSession* session, uint8_t port, uint32_t statusType)
+{
+  msg = RadiusMsg(RadiusCodeAccountingRequest);
+  RadiusAcctSessions::addAttrs(&msg, session, statusType);
+  msg.addAttr(RadiusAttrNASPort, 0, (uint32_t)port);
+  msg.addAttr(RadiusAttrUserName, 0, "test");
+  msg.sign(secret, strlen(secret));
+  handle = radius.begin(&msg, &reply);
+}
+
+void setup()
+{
+  Serial.begin(9600);
+
+  Ethernet.begin(mac, ip, gateway);
+  Udp.begin(localPort);
+  delay(1000); // Lets the Ethernet card get set up.
+
+  // A session for each port, with a unique Acct-Session-Id
+  uint8_t port;
+  for (port = 0; port < ports; port++)
+  {
+    char id[RADIUS_ACCT_SESSION_ID_SIZE];
+    sprintf(id, "%08lx%02x", millis(), port);
+    portSession[port] = sessions.start((const uint8_t*)id, strlen(id));
+  }
+}
+
+void loop()
+{
+  radius.poll();
+
+  // Made up traffic
+  uint8_t port;
+  for (port = 0; port < ports; port++)
+    RadiusAcctSessions::addTraffic(portSession[port], random(1500), random(1500), 1, 1);
+
+  // Finished with the last request?
+  if (handle >= 0 && radius.status(handle) != RadiusUdpStatusPending)
+  {
+    if (   radius.status(handle) != RadiusUdpStatusReplied
+	|| !reply.checkAuthenticatorsWithOriginal(secret, strlen(secret), &msg))
+      Serial.println("No Accounting-Response");
+    radius.release(handle);
+    handle = -1;
+  }
+  if (handle >= 0)
+    return;
+
+  // Starts first, then any interim update that is due
+  if (startSent < ports)
+  {
+    sendAcct(portSession[startSent], startSent, RadiusValueAcctStatusTypeStart);
+    startSent++;
+    return;
+  }
+  RadiusAcctSession* session = sessions.due();
+  if (session)
+  {
+    for (port = 0; port < ports && portSession[port] != session; port++)
+      ;
+    sendAcct(session, port, RadiusValueAcctStatusTypeAlive);
+  }
+}
@@ -0,0 +1,176 @@
+// RadiusBench.ino
+//
+// Microbenchmarks for the per-packet functions of the Radius library.
+// Times addAttr, getAttr, sign, encryptPassword, checkAuthenticatorsWithOriginal
+// and the md5 primitives on fixed packets, and prints the time per operation 
+// and the throughput on the serial port. Run it before and after changing the library 
+// to measure the effect of the change.
+//
+// The packets used are:
+// \li a small PAP Access-Request
+// \li a large Access-Challenge carrying EAP-Message attributes (limited to RADIUS_MAX_SIZE)
+// \li an Accounting-Request with many Vendor-Specific attributes
+//
+// The library does not use the heap, so there are no allocations to report.
+// No network connection is needed.
+//
+// $Id: $
+
+// Prevent compile complaints with some versi0ns of arduino:
+#undef abs
+#include <stdlib.h>
+
+#include <SPI.h>         // needed for Arduino versions later than 0018
+#include <Ethernet.h>
+#include <RadiusMsg.h>
+extern "C" 
+{
+#include <md5.h>
+}
+
+const char* secret = "testing123";
+uint8_t secretLength;
+
+// Number of times each operation is run
+#define ITERATIONS 200
+
+// Prevents the compiler optimising away results
+volatile uint32_t sink;
+
+// Print one result line: name, microseconds per operation and bytes per second
+void result(const char* name, unsigned long elapsed, uint16_t bytes)
+{
+  Serial.print(name);
+  Serial.print(": ");
+  Serial.print((float)elapsed / ITERATIONS);
+  Serial.print(" us/op");
+  if (bytes)
+  {
+    Serial.print(", ");
+    Serial.print((float)bytes * ITERATIONS * 1000000.0 / elapsed, 0);
+    Serial.print(" bytes/s");
+  }
+  Serial.println();
+}
+
+// Run 'op' ITERATIONS times and print the result
+#define BENCH(name, bytes, op) \
+  { \
+    unsigned long start = micros(); \
+    for (uint16_t n = 0; n < ITERATIONS; n++) \
+    { \
+      op; \
+    } \
+    result(name, micros() - start, bytes); \
+  }
+
+// Small PAP Access-Request
+void buildPap(RadiusMsg* msg)
+{
+  msg->addAttr(RadiusAttrUserName, 0, "mikem@airspayce.com");
+  msg->addAttr(RadiusAttrUserPassword, 0, "fred1234");
+  msg->addAttr(RadiusAttrNasIPAddress, 0, (uint32_t)0xc0a81419);
+  msg->addAttr(RadiusAttrNASPort, 0, (uint32_t)1);
+  msg->addAttr(RadiusAttrNASIdentifier, 0, "arduino");
+}
+
+// Large Access-Challenge with EAP-Message and State attributes
+void buildEap(RadiusMsg* msg)
+{
+  uint8_t eap[RADIUS_MAX_ATTRIBUTE_SIZE];
+  uint8_t i;
+  for (i = 0; i < sizeof(eap); i++)
+    eap[i] = i;
+  msg->addAttr(RadiusAttrEAPMessage, 0, eap, sizeof(eap));
+  msg->addAttr(RadiusAttrEAPMessage, 0, eap, sizeof(eap));
+  msg->addAttr(RadiusAttrEAPMessage, 0, eap, sizeof(eap));
+  msg->addAttr(RadiusAttrEAPMessage, 0, eap, 100);
+  msg->addAttr(RadiusAttrState, 0, eap, 16);
+  msg->addAttr(RadiusAttrSessionTimeout, 0, (uint32_t)30);
+}
+
+// Accounting-Request with many VSAs
+void buildAcct(RadiusMsg* msg)
+{
+  msg->addAttr(RadiusAttrUserName, 0, "mikem@airspayce.com");
+  msg->addAttr(RadiusAttrAcctStatusType, 0, (uint32_t)RadiusValueAcctStatusTypeAlive);
+  msg->addAttr(RadiusAttrAcctSessionId, 0, "0123456789abcdef");
+  msg->addAttr(RadiusAttrAcctInputOctets, 0, (uint32_t)123456);
+  msg->addAttr(RadiusAttrAcctOutputOctets, 0, (uint32_t)654321);
+  msg->addAttr(RadiusAttrAcctSessionTime, 0, (uint32_t)3600);
+  // Cisco-AVPair VSAs
+  uint8_t vsa[] = { 0, 0, 0, 9, 1, 24, 's','u','b','-','q','o','s','-','p','o','l','i','c','y','-','i','n','=','g','o','l','d' };
+  uint8_t i;
+  for (i = 0; i < 12; i++)
+    msg->addAttr(RadiusAttrVendorSpecific, 0, vsa, sizeof(vsa));
+}
+
+// Helper, so the request being timed is a single expression
+void encryptPasswordOnce(uint8_t* password, uint8_t length, uint8_t* iv)
+{
+  RadiusMsg msg;
+  msg.encryptPassword(password, length, secret, secretLength, iv);
+}
+
+void decryptPasswordOnce(uint8_t* password, uint8_t length, uint8_t* iv)
+{
+  RadiusMsg msg;
+  msg.decryptPassword(password, length, secret, secretLength, iv);
+}
+
+void setup()
+{
+  Serial.begin(9600);
+  secretLength = strlen(secret);
+}
+
+void loop()
+{
+  // addAttr
+  BENCH("addAttr PAP request", 0, { RadiusMsg msg(RadiusCodeAccessRequest); buildPap(&msg); });
+  BENCH("addAttr VSA accounting", 0, { RadiusMsg msg(RadiusCodeAccountingRequest); buildAcct(&msg); });
+
+  // getAttr, worst case: the last attribute in the packet
+  RadiusMsg eap(RadiusCodeAccessChallenge);
+  buildEap(&eap);
+  uint32_t timeout;
+  BENCH("getAttr uint32 EAP reply", 0, { eap.getAttr(RadiusAttrSessionTimeout, 0, &timeout); sink = timeout; });
+  uint8_t buf[RADIUS_MAX_ATTRIBUTE_SIZE];
+  BENCH("getAttr copy EAP reply", RADIUS_MAX_ATTRIBUTE_SIZE, { uint8_t length = sizeof(buf); eap.getAttr(RadiusAttrEAPMessage, 0, buf, &length, 2); sink = length; });
+  RadiusAttrView view;
+  BENCH("getAttr view EAP reply", 0, { eap.getAttr(RadiusAttrEAPMessage, 0, &view, 2); sink = view.length; });
+  RadiusMsg acct(RadiusCodeAccountingRequest);
+  buildAcct(&acct);
+  BENCH("getAttr VSA accounting", 0, { acct.getAttr(1, RadiusVendorCisco, &view, 11); sink = view.length; });
+
+  // encryptPassword
+  uint8_t password[RADIUS_PASSWORD_BLOCK_SIZE * 2] = "fred1234";
+  RadiusAuthenticator iv = { 0 };
+  BENCH("encryptPassword 16", 16, encryptPasswordOnce(password, 16, iv));
+  BENCH("encryptPassword 32", 32, encryptPasswordOnce(password, 32, iv));
+  BENCH("decryptPassword 16", 16, decryptPasswordOnce(password, 16, iv));
+  BENCH("decryptPassword 32", 32, decryptPasswordOnce(password, 32, iv));
+
+  // sign. Signing encrypts the User-Password in place, so each PAP request is copied 
+  // afresh from a template, and the time includes the copy
+  RadiusMsg papTemplate(RadiusCodeAccessRequest);
+  buildPap(&papTemplate);
+  RadiusMsg pap;
+  BENCH("sign PAP request", 0, { pap.copyTemplate(&papTemplate); pap.sign(secret, secretLength); });
+  BENCH("sign VSA accounting", 0, acct.sign(secret, secretLength));
+  BENCH("sign EAP reply", 0, eap.sign(secret, secretLength, &pap));
+
+  // checkAuthenticatorsWithOriginal
+  BENCH("verify EAP reply", 0, sink = eap.checkAuthenticatorsWithOriginal(secret, secretLength, &pap));
+  BENCH("verify VSA accounting", 0, sink = acct.checkAuthenticatorsWithOriginal(secret, secretLength, 0));
+
+  // md5 primitives
+  uint8_t data[512];
+  memset(data, 0xa5, sizeof(data));
+  uint8_t digest[16];
+  BENCH("md5 64", 64, { md5_ctx c; md5_init(&c); md5_update(&c, data, 64); md5_final(digest, &c); sink = digest[0]; });
+  BENCH("md5 512", 512, { md5_ctx c; md5_init(&c); md5_update(&c, data, 512); md5_final(digest, &c); sink = digest[0]; });
+
+  Serial.println();
+  delay(10000);
+}
@@ -0,0 +1,134 @@
+// RadiusCapture.cpp
+//
+// Captures sent and received RADIUS packets in pcap format
+//
+// $Id: $
+
+#include "RadiusCapture.h"
+#include "RadiusMsg.h"
+
+#define RADIUS_CAPTURE_MASK (RADIUS_CAPTURE_BUFFER_SIZE - 1)
+
+RadiusCapture::RadiusCapture(Print* o, IPAddress address, uint16_t port)
+{
+  out = o;
+  localAddress = address;
+  localPort = port;
+  head = tail = 0;
+  droppedPackets = 0;
+}
+
+void
+RadiusCapture::put(const uint8_t* data, uint16_t length)
+{
+  while (length--)
+    ring[head++ & RADIUS_CAPTURE_MASK] = *data++;
+}
+
+void
+RadiusCapture::put16(uint16_t value)
+{
+  ring[head++ & RADIUS_CAPTURE_MASK] = value >> 8;
+  ring[head++ & RADIUS_CAPTURE_MASK] = value;
+}
+
+void
+RadiusCapture::put32le(uint32_t value)
+{
+  uint8_t i;
+  for (i = 0; i < 4; i++, value >>= 8)
+    ring[head++ & RADIUS_CAPTURE_MASK] = value;
+}
+
+void
+RadiusCapture::begin()
+{
+  // pcap file header, little endian
+  uint8_t header[RADIUS_CAPTURE_FILE_HEADER_LENGTH] = 
+  {
+    0xd4, 0xc3, 0xb2, 0xa1,  // magic
+    2, 0, 4, 0,              // version 2.4
+    0, 0, 0, 0,              // timezone
+    0, 0, 0, 0,              // timestamp accuracy
+    (RADIUS_CAPTURE_SNAPLEN + RADIUS_CAPTURE_IP_UDP_LENGTH) & 0xff, 
+    (RADIUS_CAPTURE_SNAPLEN + RADIUS_CAPTURE_IP_UDP_LENGTH) >> 8, 0, 0, // snaplen
+    RADIUS_CAPTURE_LINKTYPE_RAW, 0, 0, 0
+  };
+  out->write(header, sizeof(header));
+}
+
+void
+RadiusCapture::capture(const uint8_t* data, uint16_t length, IPAddress peerAddress, uint16_t peerPort, uint8_t sent)
+{
+  uint16_t saved = length < RADIUS_CAPTURE_SNAPLEN ? length : RADIUS_CAPTURE_SNAPLEN;
+  uint16_t needed = RADIUS_CAPTURE_RECORD_HEADER_LENGTH + RADIUS_CAPTURE_IP_UDP_LENGTH + saved;
+  if ((uint16_t)(RADIUS_CAPTURE_BUFFER_SIZE - (uint16_t)(head - tail)) < needed)
+  {
+    droppedPackets++;
+    return;
+  }
+
+  // pcap record header
+  unsigned long now = RadiusMsg::now();
+  put32le(now / 1000);
+  put32le((now % 1000) * 1000);
+  put32le(RADIUS_CAPTURE_IP_UDP_LENGTH + saved);
+  put32le(RADIUS_CAPTURE_IP_UDP_LENGTH + length);
+
+  // IPv4 header, with no options
+  IPAddress src = sent ? localAddress : peerAddress;
+  IPAddress dst = sent ? peerAddress : localAddress;
+  uint8_t ip[20] = 
+  {
+    0x45, 0,                 // version, header length, TOS
+    (uint8_t)((RADIUS_CAPTURE_IP_UDP_LENGTH + length) >> 8), 
+    (uint8_t)(RADIUS_CAPTURE_IP_UDP_LENGTH + length),
+    0, 0, 0x40, 0,           // identification, don't fragment
+    64, 17,                  // TTL, protocol UDP
+    0, 0,                    // checksum, calculated below
+    src[0], src[1], src[2], src[3],
+    dst[0], dst[1], dst[2], dst[3]
+  };
+  uint32_t sum = 0;
+  uint8_t i;
+  for (i = 0; i < sizeof(ip); i += 2)
+    sum += (uint16_t)(ip[i] << 8 | ip[i + 1]);
+  while (sum >> 16)
+    sum = (sum & 0xffff) + (sum >> 16);
+  sum = ~sum;
+  ip[10] = sum >> 8;
+  ip[11] = sum;
+  put(ip, sizeof(ip));
+
+  // UDP header. The checksum is optional for IPv4
+  put16(sent ? localPort : peerPort);
+  put16(sent ? peerPort : localPort);
+  put16(8 + length);
+  put16(0);
+
+  put(data, saved);
+}
+
+uint16_t
+RadiusCapture::drain()
+{
+  uint16_t written = 0;
+  while (head != tail)
+  {
+    // Write the contiguous part of the ring up to the end of the buffer
+    uint16_t start = tail & RADIUS_CAPTURE_MASK;
+    uint16_t length = (uint16_t)(head - tail);
+    if (length > RADIUS_CAPTURE_BUFFER_SIZE - start)
+      length = RADIUS_CAPTURE_BUFFER_SIZE - start;
+    out->write(ring + start, length);
+    tail += length;
+    written += length;
+  }
+  return written;
+}
+
+uint32_t
+RadiusCapture::dropped()
+{
+  return droppedPackets;
+}
@@ -49,6 +49,8 @@ void setup()
   Ethernet.begin(mac, ip, gateway);
   Udp.begin(localPort);
   delay(1000); // Lets the Ethernet card get set up.
+  // Sleep instead of spinning while waiting for replies
+  RadiusMsg::setIdle(RadiusMsg::sleepIdle);
 }
 
 void loop()
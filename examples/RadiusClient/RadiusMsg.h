@@ -51,7 +51,10 @@
 #define _RADIUSMSG_H_
 
 //#include "UDPSocket.h"
-#include <EthernetUdp.h>
+#include <Udp.h>
+#include "RadiusStats.h"
+#include "RadiusCapture.h"
+#include "RadiusRandom.h"
 
 #define RADIUS_AUTHENTICATOR_LENGTH 16
 #define RADIUS_PASSWORD_BLOCK_SIZE 16
@@ -60,6 +63,10 @@
 // so we artificially limit packets to 1000 octets
 #define RADIUS_MAX_SIZE 1000
 #define RADIUS_MAX_ATTRIBUTE_SIZE 253
+// Maximum number of attributes a fragmented value such as an EAP message can be split across
+#define RADIUS_MAX_FRAGMENTS 8
+// Maximum length of the value of a salted attribute such as Tunnel-Password or MS-MPPE-Send-Key
+#define RADIUS_MAX_SALTED_SIZE 239
 typedef uint8_t RadiusAuthenticator[RADIUS_AUTHENTICATOR_LENGTH];
 
 // RADIUS message type
@@ -283,6 +290,64 @@ typedef struct
 
 } RadiusAttrHeader;
 
+/////////////////////////////////////////////////////////////////////
+/// \struct RadiusAttrView
+/// Refers to the value of an attribute inside a RadiusMsg, without copying it.
+/// Only valid while the RadiusMsg it was obtained from is unchanged
+typedef struct
+{
+    /// Pointer to the first octet of the value in the packet
+    const uint8_t* value;
+
+    /// Number of octets in the value
+    uint8_t        length;
+
+} RadiusAttrView;
+
+/////////////////////////////////////////////////////////////////////
+/// \struct RadiusAttrFragments
+/// Refers to a value split across several attributes inside a RadiusMsg, such as an 
+/// EAP message, without copying it. 
+/// Only valid while the RadiusMsg it was obtained from is unchanged
+typedef struct
+{
+    /// Each fragment of the value, in order
+    RadiusAttrView fragments[RADIUS_MAX_FRAGMENTS];
+
+    /// Number of fragments
+    uint8_t        count;
+
+    /// Total length of the value in octets
+    uint16_t       length;
+
+} RadiusAttrFragments;
+
+/////////////////////////////////////////////////////////////////////
+/// \struct RadiusIPv6Prefix
+/// Refers to an IPv6 prefix attribute (RFC 3162) inside a RadiusMsg, without copying it.
+/// Only valid while the RadiusMsg it was obtained from is unchanged
+typedef struct
+{
+    /// The prefix length in bits, 0 to 128
+    uint8_t        prefixLength;
+
+    /// Pointer to the significant octets of the prefix in the packet. 
+    /// Octets that are not present are 0
+    const uint8_t* prefix;
+
+    /// Number of octets of the prefix present in the packet, 0 to 16
+    uint8_t        length;
+
+} RadiusIPv6Prefix;
+
+/// Function called repeatedly while sendWaitReply() waits for a reply, such as to
+/// put the processor to sleep until the next interrupt. See RadiusMsg::setIdle()
+typedef void (*RadiusIdleFunction)();
+
+/// Function returning the time in milliseconds, used for all the timeouts and latencies of
+/// the library. See RadiusMsg::setClock()
+typedef unsigned long (*RadiusClockFunction)();
+
 /////////////////////////////////////////////////////////////////////
 /// \class RadiusMsg RadiusMsg.h <RadiusMsg.h>
 /// \brief Class to create, format and send RADIUS requests and replies
@@ -292,15 +357,34 @@ typedef struct
 /// to connect to a LAN and communicate with a RDAIUS server, such as Radiator RADIUS Server 
 /// (http://www.airspayce.com/radiator)
 ///
+/// Packets are sent and received with any Arduino UDP socket: EthernetUDP for the Ethernet shield,
+/// WiFiUDP on WiFi boards, or any other class derived from the UDP class in the Arduino core, 
+/// such as a test double.
+///
 /// Conforms broadly to RFC 2138 and 2139, with limitations:
-/// \li Vendor Specific Attribautes are not supported
-/// \li The only encrypted attribtute supported is User-Password
+/// \li The encrypted attributes supported are User-Password, Tunnel-Password (RFC 2868) and
+/// MS-MPPE-Send-Key and MS-MPPE-Recv-Key (RFC 2548)
+/// \li Packets, and so EAP messages, are limited to RADIUS_MAX_SIZE octets
+///
+/// EAP (RFC 3579) is supported: addEAPMessage() splits an EAP message across EAP-Message
+/// attributes and adds a Message-Authenticator, which sign() computes and checkAuthenticators()
+/// verifies. getEAPMessage() reassembles the EAP message from a reply, and copyState() carries
+/// the State from an Access-Challenge into the next request of the session.
 ///
 /// There is no RADIUS dictionary: When adding attributes to a reque or getting attriburtes 
 /// from a reply, you are required to use the appropriate calls according to the attribute 
-/// type of the attribute you are using: binary, string or integer
+/// type of the attribute you are using: binary, string or integer.
+/// Attributes in received messages can be read without copying through RadiusAttrView and the
+/// typed getAttr() calls. Date attributes such as Event-Timestamp are 32 bit unsigned integers 
+/// holding seconds since 1970.
 class RadiusMsg
 {
+    friend class RadiusAttrPlan;
+    friend class RadiusTcpClient;
+    friend class RadiusProxy;
+    friend class RadiusServer;
+    friend class RadiusUdpClient;
+
 private:
     /// The formatted RADIUS packet, including header
     RadiusPacket packet;
@@ -319,42 +403,222 @@ private:
 
     /// The port number of the peer
     uint16_t     peerPort;
+
+    /// Statistics for the server this message is sent to, or 0
+    RadiusStats* stats;
+
+    /// false until a new request has been given its identifier
+    uint8_t      identifierAllocated;
+
+    /// Give a new request its identifier, if it does not have one yet
+    void     allocateIdentifier();
+
+    /// Compute the HMAC-MD5 Message-Authenticator (RFC 3579) of the packet as it is now
+    void     messageAuthenticator(const char* secret, uint8_t secretLength, uint8_t* digest);
+
+    /// Check the Message-Authenticator, if there is one, against the packet as it is now
+    /// \return true if there is no Message-Authenticator, or it is correct
+    uint8_t  checkMessageAuthenticator(const char* secret, uint8_t secretLength);
+
+    /// Append the header of an attribute, wrapped in a Vendor Specific Attribute if vendor is not 0
+    /// \return Pointer to where the value of the attribute goes
+    uint8_t* appendAttr(unsigned type, unsigned vendor, uint8_t length);
+
+    /// Encrypt or decrypt all the encrypted attributes in the packet in one pass, hashing the 
+    /// secret only once
+    void     cryptAttrs(const char* secret, uint8_t secretLength, const uint8_t* requestAuthenticator, uint8_t decrypt);
+
+    /// Find the nth attribute with matching attribute number and vendor number
+    /// \return Pointer to the attribute, or the sub attribute of a VSA, else 0
+    const RadiusAttrHeader* findAttr(unsigned type, unsigned vendor, uint8_t skip);
     
 public:
     /// Constructor for receiving
     RadiusMsg();
 
-    /// Constructor for sending. RADIUS message type code is initialised
+    /// Constructor for sending. RADIUS message type code is initialised.
+    /// The identifier is allocated when the message is first signed, sent or its identifier
+    /// is asked for, so messages can be constructed before the random number generator can 
+    /// be seeded, such as global templates
     RadiusMsg(RadiusCode code);
+
+    /// Start a new request in this message, discarding its previous contents, as if it had 
+    /// just been constructed with RadiusMsg(code). Lets one message be reused for many 
+    /// requests without a template. Call setStats() again if the request is to be counted.
+    /// \param[in] code The RADIUS message type code of the request
+    void     initRequest(RadiusCode code);
   
+    /// Start a reply to a received request. Sets the code, the identifier of the request, 
+    /// and the peer to reply to, and copies every Proxy-State of the request, in order, as 
+    /// RFC 2865 requires. Sign the reply with sign(), passing the request.
+    /// \param[in] request The request to reply to
+    /// \param[in] code The RADIUS message type code of the reply
+    void     initReply(RadiusMsg* request, RadiusCode code);
+
+    /// Count this request, its retransmissions and its reply in a RadiusStats.
+    /// Use a separate RadiusStats for each RADIUS server.
+    /// \param[in] stats The statistics to update, or 0 to stop counting
+    void     setStats(RadiusStats* stats);
+
+    /// Save every RADIUS packet sent by sendto() and received by recv() with a RadiusCapture.
+    /// Applies to all RadiusMsg instances.
+    /// \param[in] capture The capture to save to, or 0 to stop capturing
+    static void setCapture(RadiusCapture* capture);
+
+    /// Set the random number generator used for Request Authenticators and the initial identifier.
+    /// Applies to all RadiusMsg instances. By default an internal RadiusRandom is used.
+    /// Set it, and any entropy source with RadiusRandom::setEntropySource(), before the first
+    /// message is signed.
+    /// \param[in] random The generator to use, or 0 to use the internal one
+    static void setRandom(RadiusRandom* random);
+
+    /// Fill a buffer with random octets from the generator set with setRandom()
+    /// \param[in] data The buffer to fill
+    /// \param[in] length Number of octets to fill
+    static void fillRandom(uint8_t* data, uint16_t length);
+
+    /// Set the function called repeatedly while sendWaitReply() and 
+    /// RadiusTcpClient::sendWaitReply() wait for a reply, instead of spinning at full speed.
+    /// Applies to all RadiusMsg instances. By default nothing is called.
+    /// Use sleepIdle() to save power on battery powered devices. On the host, a function 
+    /// that advances a simulated clock (see setClock()) makes timeouts take no time in tests.
+    /// \param[in] idle The function to call, or 0 for none
+    static void setIdle(RadiusIdleFunction idle);
+
+    /// Set the clock used for the timeouts, retransmissions and latencies of sendWaitReply(),
+    /// RadiusUdpClient, RadiusTcpClient and RadiusProxy, and for the timing of RadiusCapture,
+    /// RadiusReplay, RadiusMetricsServer and RadiusAcctSessions. Applies to all RadiusMsg instances.
+    /// By default millis() is used. A simulated clock, such as RadiusSimUDP::clock(), lets 
+    /// retransmission and timeout scenarios run in virtual time, much faster than real time,
+    /// and with reproducible timing.
+    /// \param[in] clock The clock to use, or 0 to use millis()
+    static void setClock(RadiusClockFunction clock);
+
+    /// Get the time from the clock set with setClock()
+    /// \return The time in milliseconds
+    static unsigned long now();
+
+    /// Call the function set with setIdle(), if any. Can also be called from loop()
+    /// while waiting for a RadiusUdpClient or RadiusTcpClient.
+    static void idle();
+
+    /// A RadiusIdleFunction that sleeps until the next interrupt. On AVR, the processor is put
+    /// in idle sleep mode, where the timer 0 overflow interrupt wakes it at least every 
+    /// millisecond, so millis() stays correct and timeouts are unaffected. Any other interrupt,
+    /// such as the Ethernet controller interrupt line if it is wired and attached, also wakes it.
+    /// Elsewhere, calls yield().
+    static void sleepIdle();
+
     /// Return the RADIUS message type code
     /// \return RADIUS message type code
     uint8_t  code();
 
+    /// Return the RADIUS identifier
+    /// \return RADIUS identifier
+    uint8_t  identifier();
+
+    /// Return the RADIUS authenticator
+    /// \return Pointer to the RADIUS_AUTHENTICATOR_LENGTH octets of the authenticator
+    const uint8_t* authenticator();
+
     /// Add an attribute to the request, binary octets
     /// \param[in] type The RADIUS attribute number
-    /// \param[in] vendor The vendor number of the attribue (unused, set to 0)
+    /// \param[in] vendor The vendor number of the attribute, 0 for standard attributes. Other
+    /// vendor numbers add a Vendor Specific Attribute with a single sub attribute, and the value
+    /// must be no longer than RADIUS_MAX_ATTRIBUTE_SIZE - 6 octets
     /// \param[in] value Pointer to the octets of the value
     /// \param[in] length Number of octets in the value
     void     addAttr(unsigned type, unsigned vendor, uint8_t* value, uint8_t length);
 
     /// Add a CString type attribute to the request
     /// \param[in] type The RADIUS attribute number
-    /// \param[in] vendor The vendor number of the attribue (unused, set to 0)
+    /// \param[in] vendor The vendor number of the attribute, 0 for standard attributes
     /// \param[in] value CString value to set. String up to (but not including) the first NUL 
     /// are used to set th value
     void     addAttr(unsigned type, unsigned vendor, const char* value);
 
     /// Add a 32 bit unsigned integer type to the request
     /// \param[in] type The RADIUS attribute number
-    /// \param[in] vendor The vendor number of the attribue (unused, set to 0)
+    /// \param[in] vendor The vendor number of the attribute, 0 for standard attributes
     /// \param[in] value 32 bit unsigned integer value
     void     addAttr(unsigned type, unsigned vendor, uint32_t value);
 
+    /// Add a value that may be longer than RADIUS_MAX_ATTRIBUTE_SIZE, split across as many
+    /// consecutive attributes of the same type as needed. Vendor attributes are split into
+    /// fragments of up to RADIUS_MAX_ATTRIBUTE_SIZE - 6 octets, each in its own Vendor Specific Attribute.
+    /// \param[in] type The RADIUS attribute number
+    /// \param[in] vendor The vendor number of the attribute, 0 for standard attributes
+    /// \param[in] value Pointer to the octets of the value
+    /// \param[in] length Number of octets in the value
+    /// \return true if the value was added, false if there is not enough room in the packet
+    uint8_t  addAttrFragments(unsigned type, unsigned vendor, const uint8_t* value, uint16_t length);
+
+    /// Add an EAP message, split across as many EAP-Message attributes as needed, and
+    /// a Message-Authenticator (required by RFC 3579) if there is not one already.
+    /// sign() computes the Message-Authenticator.
+    /// \param[in] eap The EAP message
+    /// \param[in] length Number of octets in the EAP message
+    /// \return true if the message was added, false if there is not enough room in the packet,
+    /// in which case the packet is unchanged
+    uint8_t  addEAPMessage(const uint8_t* eap, uint16_t length);
+
+    /// Add a Message-Authenticator attribute (RFC 3579), which sign() computes.
+    /// Required in packets containing EAP-Message, and recommended for Status-Server
+    void     addMessageAuthenticator();
+
+    /// Copy the State attribute from an Access-Challenge into this request, so that the next
+    /// round of a multi-round authentication such as EAP continues the same session.
+    /// \param[in] challenge The Access-Challenge received in reply to the previous request
+    /// \return true if the challenge had a State attribute, which was copied
+    uint8_t  copyState(RadiusMsg* challenge);
+
+    /// Add an attribute that is encrypted with a salt, such as Tunnel-Password, MS-MPPE-Send-Key
+    /// or MS-MPPE-Recv-Key. sign() chooses the salt and encrypts it.
+    /// \param[in] type The RADIUS attribute number
+    /// \param[in] vendor The vendor number of the attribute, 0 for standard attributes
+    /// \param[in] value Pointer to the octets of the value
+    /// \param[in] length Number of octets in the value, no more than RADIUS_MAX_SALTED_SIZE
+    /// \param[in] tag The tag of a Tunnel-Password, ignored for other attributes
+    /// \return true if the attribute was added, false if it is too long or there is not enough 
+    /// room in the packet
+    uint8_t  addAttrSalted(unsigned type, unsigned vendor, const uint8_t* value, uint8_t length, uint8_t tag = 0);
+
+    /// Reserve a fixed size attribute in the request, with its value set to all zeros, and
+    /// return the offset of the value in the packet, for later patching with setAttrSlot().
+    /// Used to build request templates: constant attributes are added once with addAttr(), 
+    /// fixed size variable fields are reserved with addAttrSlot(), and new requests are stamped 
+    /// out with copyTemplate() and setAttrSlot(). Variable length fields such as User-Name
+    /// can be added to each copy with addAttr() in the usual way.
+    /// \param[in] type The RADIUS attribute number
+    /// \param[in] vendor The vendor number of the attribute, 0 for standard attributes
+    /// \param[in] length Number of octets to reserve for the value
+    /// \return The offset of the value in the packet, or 0 if there is no room for the attribute
+    uint16_t addAttrSlot(unsigned type, unsigned vendor, uint8_t length);
+
+    /// Set the value of an attribute reserved with addAttrSlot()
+    /// \param[in] offset Offset of the value, as returned by addAttrSlot()
+    /// \param[in] value Pointer to the octets of the value
+    /// \param[in] length Number of octets in the value. Must be the same as the reserved length
+    /// \return true if set, false if the slot is not inside the packet
+    uint8_t  setAttrSlot(uint16_t offset, const uint8_t* value, uint8_t length);
+
+    /// Set the value of a 32 bit unsigned integer attribute reserved with addAttrSlot()
+    /// \param[in] offset Offset of the value, as returned by addAttrSlot()
+    /// \param[in] value 32 bit unsigned integer value
+    /// \return true if set, false if the slot is not inside the packet
+    uint8_t  setAttrSlot(uint16_t offset, uint32_t value);
+
+    /// Initialise this message as a copy of a template message: the code, retry settings
+    /// and all the attributes of the template are copied, and a new identifier is allocated. 
+    /// Only the valid octets of the template are copied.
+    /// The template must not have been signed.
+    /// \param[in] templ The template message to copy
+    void     copyTemplate(const RadiusMsg* templ);
+
     /// Get the nth attribute with matching attribute number (and optional vendor number)
     /// Skips over 'skip' attributes to get the 'skip'th matching attribute
     /// \param[in] type The RADIUS attribute number
-    /// \param[in] vendor The vendor number of the attribue (unused, set to 0)
+    /// \param[in] vendor The vendor number of the attribute, 0 for standard attributes
     /// \param[in] value Destination to copy the value to
     /// \param[in] length Caller sets this to the maximum permitted length available in value. 
     /// if return is 1, up to length octets will be copied, and *length will be set to the actual 
@@ -367,27 +631,136 @@ public:
     /// Get the nth attribute with matching attribue number (and optional vendor number) 
     /// as a 32 bit unsigned integer
     /// \param[in] type The RADIUS attribute number
-    /// \param[in] vendor The vendor number of the attribue (unused, set to 0)
+    /// \param[in] vendor The vendor number of the attribute, 0 for standard attributes
     /// \param[in] value Destination to copy the value to
     /// \param[in] skip Number of matching attributes to skip (defaults to 0,
     /// which means get the first matching one)
     /// \return true if a match was found and the value copied
     uint8_t  getAttr(unsigned type, unsigned vendor, uint32_t* value, uint8_t skip = 0);
 
+    /// Get the nth attribute with matching attribute number and vendor number, 
+    /// without copying the value.
+    /// Unlike the copying getAttr(), the value is never truncated: view->length is the 
+    /// actual length of the value in the packet.
+    /// \param[in] type The RADIUS attribute number
+    /// \param[in] vendor The vendor number of the attribute, 0 for standard attributes
+    /// \param[out] view Set to refer to the value in the packet
+    /// \param[in] skip Number of matching attributes to skip (defaults to 0,
+    /// which means get the first matching one)
+    /// \return true if a match was found
+    uint8_t  getAttr(unsigned type, unsigned vendor, RadiusAttrView* view, uint8_t skip = 0);
+
+    /// Get the nth attribute with matching attribute number and vendor number as an IPv4 address
+    /// \param[in] type The RADIUS attribute number
+    /// \param[in] vendor The vendor number of the attribute, 0 for standard attributes
+    /// \param[out] value Destination to copy the address to
+    /// \param[in] skip Number of matching attributes to skip (defaults to 0,
+    /// which means get the first matching one)
+    /// \return true if a match was found and it is a valid IPv4 address
+    uint8_t  getAttr(unsigned type, unsigned vendor, IPAddress* value, uint8_t skip = 0);
+
+    /// Get the nth attribute with matching attribute number and vendor number as an IPv6 
+    /// address, such as NAS-IPv6-Address, without copying it.
+    /// \param[in] type The RADIUS attribute number
+    /// \param[in] vendor The vendor number of the attribute, 0 for standard attributes
+    /// \param[out] address Set to point to the 16 octets of the address in the packet
+    /// \param[in] skip Number of matching attributes to skip (defaults to 0,
+    /// which means get the first matching one)
+    /// \return true if a match was found and it is a valid IPv6 address
+    uint8_t  getAttrIPv6Address(unsigned type, unsigned vendor, const uint8_t** address, uint8_t skip = 0);
+
+    /// Get the nth attribute with matching attribute number and vendor number as an IPv6 
+    /// prefix, such as Framed-IPv6-Prefix or Delegated-IPv6-Prefix, without copying it.
+    /// \param[in] type The RADIUS attribute number
+    /// \param[in] vendor The vendor number of the attribute, 0 for standard attributes
+    /// \param[out] prefix Set to refer to the prefix in the packet
+    /// \param[in] skip Number of matching attributes to skip (defaults to 0,
+    /// which means get the first matching one)
+    /// \return true if a match was found and it is a valid IPv6 prefix
+    uint8_t  getAttrIPv6Prefix(unsigned type, unsigned vendor, RadiusIPv6Prefix* prefix, uint8_t skip = 0);
+
+    /// Get the value of a salted attribute such as Tunnel-Password, MS-MPPE-Send-Key
+    /// or MS-MPPE-Recv-Key, without copying it. decryptAttrs() must be called first.
+    /// \param[in] type The RADIUS attribute number
+    /// \param[in] vendor The vendor number of the attribute, 0 for standard attributes
+    /// \param[out] view Set to refer to the decrypted value in the packet
+    /// \param[in] skip Skip this many matching attributes before returning
+    /// \return true if a match was found, and it decrypted to a valid value
+    uint8_t  getAttrSalted(unsigned type, unsigned vendor, RadiusAttrView* view, uint8_t skip = 0);
+
+    /// Remove an attribute from the message, such as the Proxy-State added by a proxy
+    /// \param[in] type The RADIUS attribute number
+    /// \param[in] vendor The vendor number of the attribute. Only 0 is supported
+    /// \param[in] skip Skip this many matching attributes, and remove the next one
+    /// \return true if a matching attribute was found and removed
+    uint8_t  removeAttr(unsigned type, unsigned vendor, uint8_t skip = 0);
+
+    /// Count the attributes with matching attribute number and vendor number
+    /// \param[in] type The RADIUS attribute number
+    /// \param[in] vendor The vendor number of the attribute, 0 for standard attributes
+    /// \return The number of matching attributes, at most 255
+    uint8_t  countAttr(unsigned type, unsigned vendor);
+
+    /// Get the User-Password of a received request, without the padding and without copying it.
+    /// decryptAttrs() must be called first.
+    /// \param[out] view Set to refer to the decrypted password in the packet
+    /// \return true if there is a User-Password
+    uint8_t  getUserPassword(RadiusAttrView* view);
+
+    /// Check the CHAP-Password of a received request (RFC 1994, RFC 2865) against the 
+    /// expected password. The challenge is the CHAP-Challenge if there is one, else the 
+    /// Request Authenticator.
+    /// \param[in] password The expected password of the user
+    /// \param[in] length Number of octets in the password
+    /// \return true if there is a CHAP-Password and it matches the password
+    uint8_t  checkChapPassword(const uint8_t* password, uint8_t length);
+
+    /// Get a value split across all the attributes with matching attribute number and vendor number, 
+    /// such as an EAP message, without copying it.
+    /// \param[in] type The RADIUS attribute number
+    /// \param[in] vendor The vendor number of the attribute, 0 for standard attributes
+    /// \param[out] fragments Set to refer to each fragment of the value in the packet
+    /// \return true if at least one match was found, and there were no more than 
+    /// RADIUS_MAX_FRAGMENTS matches
+    uint8_t  getAttrFragments(unsigned type, unsigned vendor, RadiusAttrFragments* fragments);
+
+    /// Get the EAP message from all the EAP-Message attributes, without copying it.
+    /// \param[out] fragments Set to refer to each fragment of the EAP message in the packet
+    /// \return true if there is an EAP message
+    uint8_t  getEAPMessage(RadiusAttrFragments* fragments);
+
+    /// Copy part of a fragmented value into a contiguous buffer
+    /// \param[in] fragments The fragmented value, from getAttrFragments() or getEAPMessage()
+    /// \param[in] offset Offset in the value of the first octet to copy
+    /// \param[out] dest Destination for the octets
+    /// \param[in] length Maximum number of octets to copy
+    /// \return The number of octets copied
+    static uint16_t copyFragments(const RadiusAttrFragments* fragments, uint16_t offset, uint8_t* dest, uint16_t length);
+
     /// Encrypts any parameters that require encryption, and sets the authethenticator
     /// for RADIUS codes that require it. Uses the shared secret for encryption and signing.
+    /// Computes the Message-Authenticator if there is one.
     /// \param[in] secret The RADIUS shared secret
     /// \param[in] secretLength Length of the secret in octets
     /// \param[in] original for RADIUS requests that are replies to an earlier request, this 
     /// points to the original requerst, which is required to correctly set the authenticator in the reply.
     void     sign(const char* secret, uint8_t secretLength, RadiusMsg* original = 0);
 
+    /// Like sign(), but for replies where only the authenticator of the original request has 
+    /// been kept, such as by a proxy
+    /// \param[in] secret The RADIUS shared secret
+    /// \param[in] secretLength Length of the secret in octets
+    /// \param[in] requestAuthenticator For replies, the authenticator of the original request. 
+    /// For requests with a random Request Authenticator, such as Access-Request, the Request 
+    /// Authenticator to use, such as when retransmitting, or 0 to choose a random one
+    void     signReply(const char* secret, uint8_t secretLength, const uint8_t* requestAuthenticator);
+
     /// Sends this RADIUS message on a UDP Socket
-    /// \param[in] socket Instance of UDPSocket to use to send the message
+    /// \param[in] socket The UDP socket to send the message on, such as an EthernetUDP or WiFiUDP
     /// \param[in] peer IPV4Address of the destination RADIUS peer
     /// \param[in] port Port number of the destination RADIUS peer
     /// \return Returns the sent packet size for success, else -1
-    uint16_t sendto(EthernetUDP* Udp, IPAddress peer, uint16_t port);
+    uint16_t sendto(UDP* Udp, IPAddress peer, uint16_t port);
 
     /// Utility function for encryption passwords and other data in RADIUS RFC compliant fashion
     /// \param[in] data The data octets to encrypt
@@ -397,24 +770,57 @@ public:
     /// \param[in] iv The intialisation vector
     void     encryptPassword(uint8_t* data, uint8_t length, const char* secret, uint8_t secretLength, uint8_t* iv);
 
+    /// Utility function for decrypting passwords and other data encrypted with encryptPassword(),
+    /// in place
+    /// \param[in,out] data The data octets to decrypt
+    /// \param[in] length Number of octets in data
+    /// \param[in] secret The RADIUS shared secret
+    /// \param[in] secretLength Length of the secret in octets
+    /// \param[in] iv The intialisation vector
+    void     decryptPassword(uint8_t* data, uint8_t length, const char* secret, uint8_t secretLength, uint8_t* iv);
+
+    /// Decrypt in place all the encrypted attributes (User-Password, Tunnel-Password, 
+    /// MS-MPPE-Send-Key and MS-MPPE-Recv-Key) in a received packet, in one pass. Call once, 
+    /// after checking the authenticators, and before getUserPassword() or getAttrSalted().
+    /// \param[in] secret The RADIUS shared secret
+    /// \param[in] secretLength Length of the secret in octets
+    /// \param[in] requestAuthenticator The authenticator of the request this is a reply to, 
+    /// or 0 if this is a request
+    void     decryptAttrs(const char* secret, uint8_t secretLength, const uint8_t* requestAuthenticator);
+
     /// Fill the packet data in the RadiusMsg with the next packet received on socket.
     /// Blocks until a packet is received. Packets that are received and which dont look
-    /// vaguely like a RADIUS essage are discarded
-    /// \param socket Pointer to the UDP socket to receive from
+    /// vaguely like a RADIUS essage are discarded. Only the RADIUS packet is read from the 
+    /// socket: datagrams too short to hold a RADIUS header are not read at all, and any
+    /// padding after the RADIUS length is left for the next parsePacket() to discard
+    /// \param socket Pointer to the UDP socket to receive from, such as an EthernetUDP or WiFiUDP
     /// \param[in] reply Pointer to a RadiusMsg which will be filled in with the reply
     /// \return The number of octets in the received message else 0 if the message was discarded
-    uint16_t recv(EthernetUDP* Udp, RadiusMsg* reply);
+    uint16_t recv(UDP* Udp, RadiusMsg* reply);
+
+    /// Fill the packet data in the RadiusMsg with a packet read from a stream, 
+    /// such as a capture file. Reads exactly length octets from the stream. 
+    /// Packets that dont look vaguely like a RADIUS message are discarded, and octets beyond the 
+    /// length in the RADIUS header are ignored.
+    /// \param[in] in The stream to read from
+    /// \param[in] length Number of octets to read
+    /// \return The number of octets in the RADIUS message else 0 if the message was discarded
+    uint16_t readPacket(Stream* in, uint16_t length);
 
     /// Send a message to the destiantion server, and wait for a matching reply. 
     /// Implements timeouts and retries until a matching reply is received
     /// Non-matching RADIUS requests are silently discarded.
-    /// Blocks until a satisfying reply is received or all retries are exhausted
-    /// \param[in] socket Pointer to the UDP socket used to send and receive
+    /// Blocks until a satisfying reply is received or all retries are exhausted. To carry on
+    /// with other work while waiting, use RadiusUdpClient instead.
+    /// If setStats() has been called, the request, retransmissions, reply latency, 
+    /// discarded packets and timeout are counted.
+    /// \param[in] socket Pointer to the UDP socket used to send and receive, such as an 
+    /// EthernetUDP or WiFiUDP
     /// \param[in] server IPAddress of the destination server
     /// \param[in] port The port number of the RADIUS server at the destination
     /// \param[in] reply Pointer to a RadiusMsg which will be filled in with the reply (if any)
     /// \return true if the request was snetr and a matchin reply received
-    uint8_t  sendWaitReply(EthernetUDP* Udp, IPAddress server, uint16_t port, RadiusMsg* reply);
+    uint8_t  sendWaitReply(UDP* Udp, IPAddress server, uint16_t port, RadiusMsg* reply);
 
     /// Checks that the authenticator in the RadiusMsg is correct, and that therefore is 
     /// verified as being from the expected peer. For RADIUS replies, requires the 
@@ -422,9 +828,22 @@ public:
     /// \param[in] secret The RADIUS shared secret
     /// \param[in] secretLength Length of the secret in octets
     /// \param[in] original When checking the authenticator of a RADIUS reply, this must point to the
-    /// original request
+    /// original request. If setStats() has been called on the original request, an incorrect 
+    /// authenticator is counted. If there is a Message-Authenticator, it is checked too.
     /// \return true if authenticator is correct.
     uint8_t  checkAuthenticatorsWithOriginal(const char* secret, uint8_t secretLength, RadiusMsg* original);
+
+    /// Checks that the authenticator in the RadiusMsg is correct, when the original request 
+    /// is not available but its authenticator is.
+    /// \param[in] secret The RADIUS shared secret
+    /// \param[in] secretLength Length of the secret in octets
+    /// \param[in] requestAuthenticator When checking the authenticator of a RADIUS reply, this must 
+    /// point to the authenticator of the original request. The random authenticator of an 
+    /// Access-Request, Status-Server or Status-Client can only be checked through its 
+    /// Message-Authenticator, if there is one
+    /// \return true if authenticator, and the Message-Authenticator if there is one, are correct.
+    /// false for a reply when requestAuthenticator is 0
+    uint8_t  checkAuthenticators(const char* secret, uint8_t secretLength, const uint8_t* requestAuthenticator);
 };
 
 
@@ -0,0 +1,94 @@
+// RadiusRandom.h
+//
+// ChaCha20 based random number generator for RADIUS authenticators and identifiers
+//
+// $Id: $
+
+#ifndef _RADIUSRANDOM_H_
+#define _RADIUSRANDOM_H_
+
+#if ARDUINO >= 100
+#include <Arduino.h>
+#else
+#include <wiring.h>
+#endif
+
+// Number of 64 octet ChaCha20 blocks generated at a time. The first 32 octets are used as the
+// next key, the rest are served as random numbers
+#define RADIUS_RANDOM_BLOCKS 2
+#define RADIUS_RANDOM_BLOCK_SIZE 64
+#define RADIUS_RANDOM_KEY_SIZE 32
+// Number of entropy samples taken when seeding from the entropy source
+#define RADIUS_RANDOM_SEED_SAMPLES 32
+
+/////////////////////////////////////////////////////////////////////
+/// \class RadiusRandom RadiusRandom.h <RadiusRandom.h>
+/// \brief Cryptographically strong random number generator
+///
+/// RADIUS Request Authenticators must be unpredictable, since they are used to hide 
+/// User-Password. rand() is neither unpredictable nor fast, so RadiusMsg uses this 
+/// generator instead. It runs the ChaCha20 block function in counter mode, generating
+/// RADIUS_RANDOM_BLOCKS blocks at a time into a buffer, from which random octets are served. 
+/// After each refill the key is replaced with the first 32 octets generated (fast key erasure),
+/// so earlier output cannot be recovered from the state.
+///
+/// The generator is seeded on first use. On Linux it is seeded from /dev/urandom. On other 
+/// targets it is seeded from the entropy source set with setEntropySource(), which should be a 
+/// hardware random number generator where the board has one. If no source is set, the low bits 
+/// of analogRead(A0) and the timing jitter of micros() are used, which is weak: 
+/// leave A0 unconnected, and call seed() with any other unpredictable data you have.
+/// RadiusMsg first uses the generator when the first message is signed, so set the entropy
+/// source before then, such as in setup().
+///
+/// There is one generator per thread of execution: on a single threaded board, RadiusMsg 
+/// uses one shared instance.
+class RadiusRandom
+{
+private:
+    /// The ChaCha20 key
+    uint32_t key[RADIUS_RANDOM_KEY_SIZE / 4];
+
+    /// The ChaCha20 block counter
+    uint32_t counter;
+
+    /// Generated random octets
+    uint8_t  buffer[RADIUS_RANDOM_BLOCKS * RADIUS_RANDOM_BLOCK_SIZE];
+
+    /// Index of the next unused octet in buffer
+    uint16_t next;
+
+    /// true once the generator has been seeded
+    uint8_t  seeded;
+
+    /// Generate a new buffer of random octets and replace the key
+    void     refill();
+
+    /// Seed from /dev/urandom or the entropy source
+    void     seedFromSource();
+
+public:
+    /// Constructor. The generator is seeded on first use
+    RadiusRandom();
+
+    /// Mix more entropy into the generator. Can be called at any time
+    /// \param[in] data Unpredictable octets
+    /// \param[in] length Number of octets in data
+    void     seed(const uint8_t* data, uint16_t length);
+
+    /// Fill a buffer with random octets
+    /// \param[out] data Destination for the random octets
+    /// \param[in] length Number of octets wanted
+    void     fill(uint8_t* data, uint16_t length);
+
+    /// Return a random octet
+    /// \return A random octet
+    uint8_t  byte();
+
+    /// Set the function used to seed all RadiusRandom instances. Call before the first random 
+    /// number is used
+    /// \param[in] source Function returning 32 bits from a hardware entropy source,
+    /// or 0 to use analogRead(A0) and micros()
+    static void setEntropySource(uint32_t (*source)());
+};
+
+#endif
@@ -0,0 +1,81 @@
+// RadiusStats.cpp
+//
+// Counters and latency histogram for RADIUS requests sent to a server
+//
+// $Id: $
+
+#include "RadiusStats.h"
+
+RadiusStats::RadiusStats()
+{
+  reset();
+}
+
+void
+RadiusStats::reset()
+{
+  requests = replies = retransmits = timeouts = badAuthenticators = discarded = 0;
+  memset(requestsByCode, 0, sizeof(requestsByCode));
+  memset(latency, 0, sizeof(latency));
+  latencySum = 0;
+}
+
+uint8_t
+RadiusStats::bucket(unsigned long ms)
+{
+  if (ms < RADIUS_STATS_SUB_BUCKETS)
+    return ms;
+  uint8_t shift = 0;
+  while ((ms >> shift) >= 2 * RADIUS_STATS_SUB_BUCKETS)
+    shift++;
+  uint16_t b = (shift + 1) * RADIUS_STATS_SUB_BUCKETS + (ms >> shift) - RADIUS_STATS_SUB_BUCKETS;
+  return b < RADIUS_STATS_BUCKETS ? b : RADIUS_STATS_BUCKETS - 1;
+}
+
+unsigned long
+RadiusStats::bucketLatency(uint8_t bucket)
+{
+  if (bucket < RADIUS_STATS_SUB_BUCKETS)
+    return bucket;
+  uint8_t shift = bucket / RADIUS_STATS_SUB_BUCKETS - 1;
+  return (unsigned long)(bucket % RADIUS_STATS_SUB_BUCKETS + RADIUS_STATS_SUB_BUCKETS) << shift;
+}
+
+void
+RadiusStats::recordRequest(uint8_t code)
+{
+  requests++;
+  requestsByCode[code < RADIUS_STATS_CODES ? code : 0]++;
+}
+
+void
+RadiusStats::recordLatency(unsigned long ms)
+{
+  latency[bucket(ms)]++;
+  latencySum += ms;
+}
+
+void
+RadiusStats::snapshot(RadiusStats* copy)
+{
+  memcpy(copy, this, sizeof(RadiusStats));
+}
+
+unsigned long
+RadiusStats::percentile(uint8_t percent)
+{
+  uint32_t count = 0;
+  uint8_t i;
+  for (i = 0; i < RADIUS_STATS_BUCKETS; i++)
+    count += latency[i];
+
+  uint32_t wanted = ((uint64_t)count * percent + 99) / 100;
+  uint32_t seen = 0;
+  for (i = 0; i < RADIUS_STATS_BUCKETS; i++)
+  {
+    seen += latency[i];
+    if (seen >= wanted && seen)
+      return bucketLatency(i);
+  }
+  return 0; // No replies
+}
@@ -0,0 +1,195 @@
+// RadiusLoad.ino
+//
+// Sample RADIUS load generator using the Radius library for ArduinoMega and Ethernet Shield.
+// Sends a configurable mix of Access-Request, Accounting-Request and Status-Server 
+// requests to a RADIUS server at a target rate, and periodically prints the throughput, 
+// timeouts, retransmissions and latency percentiles, as counted by RadiusStats, 
+// on the serial port.
+// Useful for finding out how many requests per second a board and server can sustain, and 
+// for catching performance regressions in the library.
+//
+// Up to concurrency requests are kept outstanding at once with RadiusUdpClient, so the rate
+// is not limited to one request per round trip. If the server cannot keep up with the target
+// rate, the achieved rate will be lower than the target. Each outstanding request takes about
+// 2k of RAM for the request and its reply, and the statistics and clients take about 2k more,
+// so on a Mega keep concurrency at 2. Requests are built in place rather than copied from 
+// templates, which would take another 1k each.
+//
+// $Id: $
+
+// Prevent compile complaints with some versi0ns of arduino:
+#undef abs
+#include <stdlib.h>
+
+#include <SPI.h>         // needed for Arduino versions later than 0018
+#include <Ethernet.h>
+#include <EthernetUdp.h>
+#include <RadiusMsg.h>
+#include <RadiusUdpClient.h>
+
+// This is the MAC address that your Ethernet shield will use
+// Configure to suit your needs
+byte mac[] = { 0xDE, 0xAD, 0xBE, 0xEF, 0xFE, 0xED };
+// Configure IP to be a suitable address for your network
+IPAddress ip = { 192, 168, 20, 25};
+// Configure server to be the IP address of your RADIUS server
+IPAddress server = { 192, 168, 20, 254 };
+// Configure gateway to be the IP address of your gateway router
+IPAddress gateway = { 192, 168, 20, 254 };
+unsigned int localPort = 8888;      // local ports to listen on: this one and the next
+unsigned int authPort  = 1812;      // RADIUS authentication port on the server
+unsigned int acctPort  = 1813;      // RADIUS accounting port on the server
+
+// Credentials
+const char* user   = "test";
+const char* password = "password";
+const char* secret = "testing123";
+
+// Target request rate in requests per second. 0 means as fast as possible
+unsigned int targetRate = 10;
+// Relative weights of the request types in the mix
+unsigned int accessWeight  = 6;
+unsigned int acctWeight    = 3;
+unsigned int statusWeight  = 1;
+// How often to print a report, in milliseconds
+unsigned long reportInterval = 10000;
+// Number of requests to keep outstanding at once, up to RADIUS_UDP_MAX_PENDING
+const uint8_t concurrency = 2;
+
+// Counters and latency histogram since the last report
+RadiusStats stats;
+RadiusStats report;
+unsigned long latencyMax;
+unsigned long lastReport;
+unsigned long nextSend;
+
+// Each RadiusUdpClient needs a socket of its own
+EthernetUDP authUdp;
+EthernetUDP acctUdp;
+RadiusUdpClient authClient(&authUdp, server, authPort);
+RadiusUdpClient acctClient(&acctUdp, server, acctPort);
+
+// The outstanding requests
+RadiusMsg        requests[concurrency];
+RadiusMsg        replies[concurrency];
+RadiusUdpClient* clients[concurrency];
+int8_t           handles[concurrency];
+unsigned long    sendTimes[concurrency];
+
+void printReport()
+{
+  unsigned long now = millis();
+  unsigned long elapsed = now - lastReport;
+  stats.snapshot(&report);
+  stats.reset();
+  Serial.print("sent: ");
+  Serial.print(report.requests);
+  Serial.print(" replies: ");
+  Serial.print(report.replies);
+  Serial.print(" timeouts: ");
+  Serial.print(report.timeouts);
+  Serial.print(" retransmits: ");
+  Serial.print(report.retransmits);
+  Serial.print(" replies/s: ");
+  Serial.print(report.replies * 1000.0 / elapsed);
+  Serial.print(" latency ms p50: ");
+  Serial.print(report.percentile(50));
+  Serial.print(" p90: ");
+  Serial.print(report.percentile(90));
+  Serial.print(" p99: ");
+  Serial.print(report.percentile(99));
+  Serial.print(" max: ");
+  Serial.println(latencyMax);
+
+  latencyMax = 0;
+  lastReport = now;
+}
+
+void setup()
+{
+  Serial.begin(9600);
+
+  Ethernet.begin(mac, ip, gateway);
+  authUdp.begin(localPort);
+  acctUdp.begin(localPort + 1);
+  delay(1000); // Lets the Ethernet card get set up.
+
+  uint8_t i;
+  for (i = 0; i < concurrency; i++)
+    handles[i] = -1;
+  lastReport = nextSend = millis();
+}
+
+void loop()
+{
+  authClient.poll();
+  acctClient.poll();
+
+  // Finish any requests that have been answered or have timed out
+  uint8_t i;
+  int8_t slot = -1;
+  for (i = 0; i < concurrency; i++)
+  {
+    if (handles[i] >= 0 && clients[i]->status(handles[i]) != RadiusUdpStatusPending)
+    {
+      if (clients[i]->status(handles[i]) == RadiusUdpStatusReplied)
+      {
+	// Incorrect authenticators are counted in stats
+	replies[i].checkAuthenticatorsWithOriginal(secret, strlen(secret), &requests[i]);
+	unsigned long ms = millis() - sendTimes[i];
+	if (ms > latencyMax)
+	  latencyMax = ms;
+      }
+      clients[i]->release(handles[i]);
+      handles[i] = -1;
+    }
+    if (handles[i] < 0)
+      slot = i;
+  }
+
+  if (millis() - lastReport >= reportInterval)
+    printReport();
+
+  unsigned long now = millis();
+  if (slot < 0)
+    return; // concurrency requests already outstanding
+  if (targetRate && (long)(now - nextSend) < 0)
+    return; // Not time to send the next request yet
+  if (targetRate)
+    nextSend += 1000 / targetRate;
+
+  // Pick the next request type from the mix
+  RadiusMsg* msg = &requests[slot];
+  RadiusUdpClient* client = &authClient;
+  unsigned int pick = random(accessWeight + acctWeight + statusWeight);
+  if (pick < accessWeight)
+  {
+    msg->initRequest(RadiusCodeAccessRequest);
+    msg->addAttr(RadiusAttrNASIdentifier, 0, "radiusload");
+    msg->addAttr(RadiusAttrServiceType, 0, (uint32_t)1);
+    msg->addAttr(RadiusAttrNASPort, 0, (uint32_t)stats.requests);
+    msg->addAttr(RadiusAttrUserName, 0, user);
+    msg->addAttr(RadiusAttrUserPassword, 0, password);
+  }
+  else if (pick < accessWeight + acctWeight)
+  {
+    msg->initRequest(RadiusCodeAccountingRequest);
+    msg->addAttr(RadiusAttrNASIdentifier, 0, "radiusload");
+    msg->addAttr(RadiusAttrAcctStatusType, 0, (uint32_t)RadiusValueAcctStatusTypeAlive);
+    msg->addAttr(RadiusAttrAcctSessionId, 0, "radiusload-1");
+    msg->addAttr(RadiusAttrAcctSessionTime, 0, (uint32_t)(now / 1000));
+    client = &acctClient;
+  }
+  else
+  {
+    msg->initRequest(RadiusCodeStatusServer);
+    msg->addAttr(RadiusAttrNASIdentifier, 0, "radiusload");
+    msg->addMessageAuthenticator(); // Required by RFC 5997
+  }
+  msg->setStats(&stats); // Counted in stats
+  msg->sign(secret, strlen(secret));
+
+  clients[slot] = client;
+  sendTimes[slot] = now;
+  handles[slot] = client->begin(msg, &replies[slot]);
+}
@@ -0,0 +1,81 @@
+// RadiusProxy.ino
+//
+// Sample RADIUS proxy using the Radius library for ArduinoMega and Ethernet Shield.
+// Receives RADIUS requests from clients on the usual RADIUS ports, forwards them to an 
+// upstream RADIUS server with a different shared secret, and forwards the replies back.
+// Prints the proxy counters on the serial port every 10 seconds.
+//
+// $Id: $
+
+// Prevent compile complaints with some versi0ns of arduino:
+#undef abs
+#include <stdlib.h>
+
+#include <SPI.h>         // needed for Arduino versions later than 0018
+#include <Ethernet.h>
+#include <EthernetUdp.h>
+#include <RadiusMsg.h>
+#include <RadiusProxy.h>
+
+// This is the MAC address that your Ethernet shield will use
+// Configure to suit your needs
+byte mac[] = { 0xDE, 0xAD, 0xBE, 0xEF, 0xFE, 0xED };
+// Configure IP to be a suitable address for your network
+IPAddress ip = { 192, 168, 20, 25};
+// Configure server to be the IP address of your upstream RADIUS server
+IPAddress server = { 192, 168, 20, 254 };
+// Configure gateway to be the IP address of your gateway router
+IPAddress gateway = { 192, 168, 20, 254 };
+unsigned int authPort  = 1812;      // RADIUS authentication port, here and on the server
+unsigned int acctPort  = 1813;      // RADIUS accounting port, here and on the server
+unsigned int authUpstreamPort = 8888; // local ports to forward from
+unsigned int acctUpstreamPort = 8889;
+
+// Secrets
+const char* clientSecret   = "testing123";
+const char* upstreamSecret = "upstream456";
+
+// Sockets for each side of each proxy
+EthernetUDP authClientUdp;
+EthernetUDP authUpstreamUdp;
+EthernetUDP acctClientUdp;
+EthernetUDP acctUpstreamUdp;
+
+RadiusProxy authProxy(&authClientUdp, &authUpstreamUdp, server, authPort, clientSecret, upstreamSecret);
+RadiusProxy acctProxy(&acctClientUdp, &acctUpstreamUdp, server, acctPort, clientSecret, upstreamSecret);
+unsigned long lastReport;
+
+void printProxy(const char* name, RadiusProxy* proxy)
+{
+  Serial.print(name);
+  Serial.print(" requests: ");
+  Serial.print(proxy->requests);
+  Serial.print(" replies: ");
+  Serial.print(proxy->replies);
+  Serial.print(" dropped: ");
+  Serial.println(proxy->dropped);
+}
+
+void setup()
+{
+  Serial.begin(9600);
+
+  Ethernet.begin(mac, ip, gateway);
+  authClientUdp.begin(authPort);
+  authUpstreamUdp.begin(authUpstreamPort);
+  acctClientUdp.begin(acctPort);
+  acctUpstreamUdp.begin(acctUpstreamPort);
+  delay(1000); // Lets the Ethernet card get set up.
+}
+
+void loop()
+{
+  authProxy.poll();
+  acctProxy.poll();
+  if (millis() - lastReport >= 10000)
+  {
+    lastReport = millis();
+    printProxy("auth", &authProxy);
+    printProxy("acct", &acctProxy);
+  }
+}
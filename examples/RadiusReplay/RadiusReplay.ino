@@ -0,0 +1,91 @@
+// RadiusReplay.ino
+//
+// Sample sketch that replays a pcap capture of RADIUS traffic from an SD card through the
+// Radius library's decoding and authenticator checking, and prints the number of packets
+// per second and any authenticator failures on the serial port.
+// The capture can come from RadiusCapture, or from tcpdump on a host:
+//   tcpdump -w capture.pcp udp port 1812 or udp port 1813
+// The SD library only supports 8.3 file names, hence the .pcp extension.
+// All packets in the capture must use the same RADIUS shared secret.
+//
+// $Id: $
+
+// Prevent compile complaints with some versi0ns of arduino:
+#undef abs
+#include <stdlib.h>
+
+#include <SPI.h>         // needed for Arduino versions later than 0018
+#include <SD.h>
+#include <Ethernet.h>
+#include <RadiusMsg.h>
+#include <RadiusReplay.h>
+
+// The SD card chip select pin. 4 on the Ethernet shield
+const int chipSelect = 4;
+// The capture file on the SD card
+const char* captureFile = "capture.pcp";
+// The RADIUS shared secret used in the capture
+const char* secret = "testing123";
+// true to replay at the captured rate, false to replay as fast as possible
+uint8_t paced = false;
+
+void setup()
+{
+  Serial.begin(9600);
+  if (!SD.begin(chipSelect))
+  {
+    Serial.println("SD card failed");
+    return;
+  }
+  File file = SD.open(captureFile);
+  if (!file)
+  {
+    Serial.println("Cannot open capture file");
+    return;
+  }
+
+  RadiusReplay replay(&file, secret, strlen(secret));
+  if (!replay.begin())
+  {
+    Serial.println("Not a supported pcap file");
+    return;
+  }
+  replay.setPaced(paced);
+
+  // Extract some typical attributes from every packet
+  RadiusAttrPlan plan;
+  plan.add(RadiusAttrUserName, 0);
+  plan.add(RadiusAttrFramedIPAddress, 0);
+  plan.add(RadiusAttrSessionTimeout, 0);
+  plan.add(RadiusAttrClass, 0);
+  plan.add(RadiusAttrAcctSessionId, 0);
+  replay.setPlan(&plan);
+
+  RadiusMsg msg;
+  unsigned long start = millis();
+  while (replay.next(&msg))
+    ;
+  unsigned long elapsed = millis() - start;
+  file.close();
+
+  Serial.print("packets: ");
+  Serial.print(replay.packets);
+  Serial.print(" packets/s: ");
+  Serial.println(elapsed ? replay.packets * 1000.0 / elapsed : 0);
+  Serial.print("verified: ");
+  Serial.print(replay.verified);
+  Serial.print(" failed: ");
+  Serial.print(replay.failed);
+  Serial.print(" unmatched: ");
+  Serial.print(replay.unmatched);
+  Serial.print(" unverifiable: ");
+  Serial.print(replay.unverifiable);
+  Serial.print(" malformed: ");
+  Serial.print(replay.malformed);
+  Serial.print(" skipped: ");
+  Serial.println(replay.skipped);
+}
+
+void loop()
+{
+}
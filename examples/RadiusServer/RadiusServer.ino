@@ -0,0 +1,89 @@
+// RadiusServer.ino
+//
+// Sample RADIUS server using the Radius library for ArduinoMega and Ethernet Shield.
+// Accepts Access-Requests with PAP or CHAP for a single configured user, and 
+// prints the server counters and queue depth on the serial port every 10 seconds.
+//
+// $Id: $
+
+// Prevent compile complaints with some versi0ns of arduino:
+#undef abs
+#include <stdlib.h>
+
+#include <SPI.h>         // needed for Arduino versions later than 0018
+#include <Ethernet.h>
+#include <EthernetUdp.h>
+#include <RadiusMsg.h>
+#include <RadiusServer.h>
+
+// This is the MAC address that your Ethernet shield will use
+// Configure to suit your needs
+byte mac[] = { 0xDE, 0xAD, 0xBE, 0xEF, 0xFE, 0xED };
+// Configure IP to be a suitable address for your network
+IPAddress ip = { 192, 168, 20, 25};
+// Configure gateway to be the IP address of your gateway router
+IPAddress gateway = { 192, 168, 20, 254 };
+unsigned int authPort = 1812;      // RADIUS authentication port to listen on
+
+// Credentials
+const char* user     = "test";
+const char* password = "password";
+const char* secret   = "testing123";
+
+RadiusServerResult handleRequest(RadiusServer* server, uint8_t slot, RadiusMsg* request)
+{
+  if (request->code() != RadiusCodeAccessRequest)
+  {
+    server->drop(slot);
+    return RadiusServerDone;
+  }
+
+  RadiusAttrView name, pw;
+  uint8_t ok = request->getAttr(RadiusAttrUserName, 0, &name)
+    && name.length == strlen(user)
+    && memcmp(name.value, user, name.length) == 0;
+  if (ok && request->getUserPassword(&pw))
+    ok = pw.length == strlen(password) && memcmp(pw.value, password, pw.length) == 0;
+  else if (ok)
+    ok = request->checkChapPassword((const uint8_t*)password, strlen(password));
+
+  RadiusMsg* reply = server->reply(slot, ok ? RadiusCodeAccessAccept : RadiusCodeAccessReject);
+  if (ok)
+    reply->addAttr(RadiusAttrSessionTimeout, 0, (uint32_t)3600);
+  server->sendReply();
+  return RadiusServerDone;
+}
+
+EthernetUDP Udp;
+RadiusServer server(&Udp, secret, handleRequest);
+unsigned long lastReport;
+
+void setup()
+{
+  Serial.begin(9600);
+
+  Ethernet.begin(mac, ip, gateway);
+  Udp.begin(authPort);
+  delay(1000); // Lets the Ethernet card get set up.
+}
+
+void loop()
+{
+  server.poll();
+  if (millis() - lastReport >= 10000)
+  {
+    lastReport = millis();
+    Serial.print("requests: ");
+    Serial.print(server.requests);
+    Serial.print(" replies: ");
+    Serial.print(server.replies);
+    Serial.print(" dropped: ");
+    Serial.print(server.dropped);
+    Serial.print(" duplicates: ");
+    Serial.print(server.duplicates);
+    Serial.print(" depth: ");
+    Serial.print(server.depth());
+    Serial.print(" max depth: ");
+    Serial.println(server.maxDepth);
+  }
+}
@@ -0,0 +1,243 @@
+// RadiusSimulation.ino
+//
+// Sample simulation of a RADIUS client, proxy and server over a lossy network, using the 
+// Radius library. No network hardware is needed: the client talks to the proxy, and the proxy
+// to the server, through RadiusSimUDP sockets in memory, which lose, duplicate, delay and 
+// reorder datagrams, and all the timeouts run on a virtual clock. Sends 1000 Access-Requests 
+// through the proxy, alternately with PAP and CHAP, 4 at a time, with the usual 5 second 
+// timeout and 3 tries, and prints how many were answered, retransmitted and timed out, and 
+// how long that took in virtual time and in real time.
+// It is also a loopback test of the library: every reply must have correct authenticators,
+// be an Access-Accept, and carry back the two Proxy-States of its request in order, and 
+// every request must either be answered or time out. It prints PASS or FAIL at the end.
+// Uses about 32k of RAM, so run it on a board such as an ESP32 or Arduino Due, not a Mega.
+//
+// $Id: $
+
+// Prevent compile complaints with some versi0ns of arduino:
+#undef abs
+#include <stdlib.h>
+
+#include <RadiusMsg.h>
+#include <RadiusServer.h>
+#include <RadiusProxy.h>
+#include <RadiusUdpClient.h>
+#include <RadiusSimUDP.h>
+extern "C" 
+{
+#include <md5.h>
+}
+
+// The simulated network
+IPAddress clientAddress = { 10, 0, 0, 1 };
+IPAddress serverAddress = { 10, 0, 0, 2 };
+IPAddress proxyAddress  = { 10, 0, 0, 3 };
+unsigned int clientPort        = 1645;
+unsigned int serverPort        = 1812;
+unsigned int proxyPort         = 1812;
+unsigned int proxyUpstreamPort = 8888;
+
+// Number of requests to send, and how many to have outstanding at once
+const uint32_t requestCount = 1000;
+const uint8_t  window       = 4;
+
+const char* secret         = "testing123";  // Between the client and the proxy
+const char* upstreamSecret = "upstream456"; // Between the proxy and the server
+const char* user     = "test";
+const char* password = "password";
+
+RadiusSimUDP clientUdp(clientAddress);
+RadiusSimUDP proxyUdp(proxyAddress);
+RadiusSimUDP proxyUpstreamUdp(proxyAddress);
+RadiusSimUDP serverUdp(serverAddress);
+
+// Accept the user with the right PAP or CHAP password
+RadiusServerResult handleRequest(RadiusServer* server, uint8_t slot, RadiusMsg* request)
+{
+  RadiusAttrView name, pw;
+  uint8_t ok = request->getAttr(RadiusAttrUserName, 0, &name)
+    && name.length == strlen(user)
+    && memcmp(name.value, user, name.length) == 0;
+  if (ok && request->getUserPassword(&pw))
+    ok = pw.length == strlen(password) && memcmp(pw.value, password, pw.length) == 0;
+  else if (ok)
+    ok = request->checkChapPassword((const uint8_t*)password, strlen(password));
+  server->reply(slot, ok ? RadiusCodeAccessAccept : RadiusCodeAccessReject);
+  server->sendReply();
+  return RadiusServerDone;
+}
+
+// Sign a request with a CHAP-Password, whose challenge is the Request Authenticator 
+// chosen by signing it (RFC 2865 2.2)
+void signChap(RadiusMsg* msg)
+{
+  msg->sign(secret, strlen(secret));
+  uint8_t authenticator[RADIUS_AUTHENTICATOR_LENGTH];
+  memcpy(authenticator, msg->authenticator(), sizeof(authenticator));
+  uint8_t chap[1 + RADIUS_AUTHENTICATOR_LENGTH];
+  chap[0] = msg->identifier();
+  md5_ctx context;
+  md5_init(&context);
+  md5_update(&context, chap, 1);
+  md5_update(&context, (uint8_t*)password, strlen(password));
+  md5_update(&context, authenticator, sizeof(authenticator));
+  md5_final(chap + 1, &context);
+  msg->addAttr(RadiusAttrChapPassword, 0, chap, sizeof(chap));
+  // Sign again, keeping the same Request Authenticator
+  msg->signReply(secret, strlen(secret), authenticator);
+}
+
+// Check that the reply carries the Proxy-States of the request, in the same order
+uint8_t checkProxyStates(RadiusMsg* request, RadiusMsg* reply)
+{
+  uint8_t count = request->countAttr(RadiusAttrProxyState, 0);
+  if (reply->countAttr(RadiusAttrProxyState, 0) != count)
+    return false;
+  uint8_t i;
+  for (i = 0; i < count; i++)
+  {
+    RadiusAttrView sent, received;
+    request->getAttr(RadiusAttrProxyState, 0, &sent, i);
+    reply->getAttr(RadiusAttrProxyState, 0, &received, i);
+    if (   sent.length != received.length
+	|| memcmp(sent.value, received.value, sent.length) != 0)
+      return false;
+  }
+  return true;
+}
+
+RadiusServer server(&serverUdp, upstreamSecret, handleRequest);
+RadiusProxy proxy(&proxyUdp, &proxyUpstreamUdp, serverAddress, serverPort, secret, upstreamSecret);
+RadiusUdpClient client(&clientUdp, proxyAddress, proxyPort);
+RadiusStats stats;
+
+RadiusMsg requests[window];
+RadiusMsg replies[window];
+int8_t handles[window];
+uint32_t sent = 0;
+uint32_t accepted = 0;
+uint32_t failed = 0;
+unsigned long realStartTime;
+
+void setup()
+{
+  Serial.begin(9600);
+
+  // Datagrams take 10 to 60 ms on each hop. 5% are lost on each hop towards the server,
+  // 10% on each hop back, and 5% of the replies from the server arrive twice
+  clientUdp.connect(&proxyUdp);
+  proxyUdp.connect(&clientUdp);
+  proxyUpstreamUdp.connect(&serverUdp);
+  serverUdp.connect(&proxyUpstreamUdp);
+  clientUdp.setLatency(10, 50);
+  proxyUdp.setLatency(10, 50);
+  proxyUpstreamUdp.setLatency(10, 50);
+  serverUdp.setLatency(10, 50);
+  clientUdp.setLoss(5);
+  proxyUpstreamUdp.setLoss(5);
+  proxyUdp.setLoss(10);
+  serverUdp.setLoss(10);
+  serverUdp.setDuplication(5);
+  clientUdp.setSeed(1);
+  proxyUdp.setSeed(2);
+  proxyUpstreamUdp.setSeed(3);
+  serverUdp.setSeed(4);
+  clientUdp.begin(clientPort);
+  proxyUdp.begin(proxyPort);
+  proxyUpstreamUdp.begin(proxyUpstreamPort);
+  serverUdp.begin(serverPort);
+
+  // All the library timing uses the virtual clock
+  RadiusMsg::setClock(RadiusSimUDP::clock);
+
+  uint8_t i;
+  for (i = 0; i < window; i++)
+    handles[i] = -1;
+  realStartTime = millis();
+}
+
+void loop()
+{
+  uint8_t i;
+  uint8_t busy = false;
+  for (i = 0; i < window; i++)
+  {
+    // Finished with a request?
+    if (handles[i] >= 0 && client.status(handles[i]) != RadiusUdpStatusPending)
+    {
+      if (client.status(handles[i]) == RadiusUdpStatusReplied)
+      {
+	if (   replies[i].checkAuthenticatorsWithOriginal(secret, strlen(secret), &requests[i])
+	    && replies[i].code() == RadiusCodeAccessAccept
+	    && checkProxyStates(&requests[i], &replies[i]))
+	  accepted++;
+	else
+	  failed++;
+      }
+      client.release(handles[i]);
+      handles[i] = -1;
+    }
+    // Send another
+    if (handles[i] < 0 && sent < requestCount)
+    {
+      requests[i].initRequest(RadiusCodeAccessRequest);
+      requests[i].setStats(&stats);
+      requests[i].addAttr(RadiusAttrUserName, 0, user);
+      // As if the client were a proxy itself
+      requests[i].addAttr(RadiusAttrProxyState, 0, "sim");
+      requests[i].addAttr(RadiusAttrProxyState, 0, (uint32_t)sent);
+      if (sent % 2)
+	signChap(&requests[i]);
+      else
+      {
+	requests[i].addAttr(RadiusAttrUserPassword, 0, password);
+	requests[i].sign(secret, strlen(secret));
+      }
+      handles[i] = client.begin(&requests[i], &replies[i]);
+      if (handles[i] >= 0)
+	sent++;
+    }
+    if (handles[i] >= 0)
+      busy = true;
+  }
+
+  if (busy)
+  {
+    server.poll();
+    proxy.poll();
+    client.poll();
+    RadiusSimUDP::tick();
+    return;
+  }
+
+  // All done
+  Serial.print("requests: ");
+  Serial.print(stats.requests);
+  Serial.print(" accepted: ");
+  Serial.print(accepted);
+  Serial.print(" failed: ");
+  Serial.print(failed);
+  Serial.print(" retransmits: ");
+  Serial.print(stats.retransmits);
+  Serial.print(" timeouts: ");
+  Serial.print(stats.timeouts);
+  Serial.print(" dropped by proxy: ");
+  Serial.print(proxy.dropped);
+  Serial.print(" latency ms p50: ");
+  Serial.print(stats.percentile(50));
+  Serial.print(" p99: ");
+  Serial.println(stats.percentile(99));
+  Serial.print("virtual time ms: ");
+  Serial.print(RadiusSimUDP::clock());
+  Serial.print(" real time ms: ");
+  Serial.println(millis() - realStartTime);
+  // Every request was answered correctly, or timed out after all its tries
+  if (   failed == 0 
+      && stats.requests == requestCount
+      && accepted + stats.timeouts == requestCount)
+    Serial.println("PASS");
+  else
+    Serial.println("FAIL");
+  while (1)
+    ;
+}
@@ -0,0 +1,90 @@
+// RadiusTcpClient.ino
+//
+// Sample RADIUS client using RADIUS over TCP (RFC 6613) with the Radius library for 
+// ArduinoMega and Ethernet Shield.
+// Keeps one TCP connection open to the RADIUS server and sends an Access-Request over it
+// every second. There are no RADIUS retransmissions: TCP takes care of lost segments.
+// loop() does not block waiting for the reply: a callback is called when it arrives.
+// The server must support RADIUS over TCP, such as Radiator or FreeRADIUS with a TCP listener.
+//
+// $Id: $
+
+// Prevent compile complaints with some versi0ns of arduino:
+#undef abs
+#include <stdlib.h>
+
+#include <SPI.h>         // needed for Arduino versions later than 0018
+#include <Ethernet.h>
+#include <RadiusMsg.h>
+#include <RadiusTcpClient.h>
+
+// This is the MAC address that your Ethernet shield will use
+// Configure to suit your needs
+byte mac[] = { 0xDE, 0xAD, 0xBE, 0xEF, 0xFE, 0xED };
+// Configure IP to be a suitable address for your network
+IPAddress ip = { 192, 168, 20, 25};
+// Configure server to be the IP address of your RADIUS server
+IPAddress server = { 192, 168, 20, 254 };
+// Configure gateway to be the IP address of your gateway router
+IPAddress gateway = { 192, 168, 20, 254 };
+unsigned int serverPort = 1812;      // RADIUS over TCP port on the server
+
+// Credentials
+const char* user     = "test";
+const char* password = "password";
+const char* secret   = "testing123";
+
+// The TCP connection to the server, and the RADIUS client using it
+EthernetClient client;
+RadiusTcpClient radius(&client, server, serverPort);
+
+void setup()
+{
+  Serial.begin(9600);
+
+  Ethernet.begin(mac, ip, gateway);
+  delay(1000); // Lets the Ethernet card get set up.
+}
+
+// The request being sent, and its reply. They must remain valid until the request completes
+RadiusMsg msg;
+RadiusMsg reply;
+int8_t handle = -1;
+unsigned long lastSendTime = 0;
+
+// Called by radius.poll() when the reply arrives or the request times out
+void replied(RadiusTcpClient* client, int8_t h, uint8_t status, void* context)
+{
+  if (   status == RadiusTcpStatusReplied
+      && reply.checkAuthenticatorsWithOriginal(secret, strlen(secret), &msg)
+      && reply.code() == RadiusCodeAccessAccept)
+  {
+    Serial.println("Got Access-Accept");
+  }
+  else
+  {
+    Serial.println("No Access-Accept");
+  }
+  client->release(h);
+  handle = -1;
+}
+
+void loop()
+{
+  radius.poll();
+
+  if (handle < 0 && millis() - lastSendTime >= 1000)
+  {
+    // Build a new Access Request
+    msg = RadiusMsg(RadiusCodeAccessRequest);
+    msg.addAttr(RadiusAttrUserName, 0, user);
+    msg.addAttr(RadiusAttrUserPassword, 0, password);
+    msg.sign(secret, strlen(secret));
+
+    // Send it over the connection. replied() is called later
+    handle = radius.send(&msg, &reply, replied);
+    lastSendTime = millis();
+  }
+
+  // Other work can be done here while the request is outstanding
+}
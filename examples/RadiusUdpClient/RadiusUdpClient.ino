@@ -0,0 +1,110 @@
+// RadiusUdpClient.ino
+//
+// Sample non-blocking RADIUS client using the Radius library for ArduinoMega and Ethernet Shield.
+// Sends an Access-Request when a button is pressed, and opens a door relay for 5 seconds
+// if it is accepted. loop() never blocks waiting for the RADIUS server, so the status LED
+// keeps blinking and the relay is closed on time, even while requests are being retransmitted.
+//
+// $Id: $
+
+// Prevent compile complaints with some versi0ns of arduino:
+#undef abs
+#include <stdlib.h>
+
+#include <SPI.h>         // needed for Arduino versions later than 0018
+#include <Ethernet.h>
+#include <EthernetUdp.h>
+#include <RadiusMsg.h>
+#include <RadiusUdpClient.h>
+
+// This is the MAC address that your Ethernet shield will use
+// Configure to suit your needs
+byte mac[] = { 0xDE, 0xAD, 0xBE, 0xEF, 0xFE, 0xED };
+// Configure IP to be a suitable address for your network
+IPAddress ip = { 192, 168, 20, 25};
+// Configure server to be the IP address of your RADIUS server
+IPAddress server = { 192, 168, 20, 254 };
+// Configure gateway to be the IP address of your gateway router
+IPAddress gateway = { 192, 168, 20, 254 };
+unsigned int localPort = 8888;      // local port to listen on
+unsigned int serverPort = 1812;      // RADIUS authentication port on the server
+
+// Credentials
+const char* user     = "test";
+const char* password = "password";
+const char* secret   = "testing123";
+
+// Pins
+const int buttonPin = 2;
+const int relayPin  = 7;
+const int ledPin    = 13;
+
+EthernetUDP Udp;
+RadiusUdpClient radius(&Udp, server, serverPort);
+
+// The request being sent, and its reply. They must remain valid until the request completes
+RadiusMsg msg;
+RadiusMsg reply;
+int8_t handle = -1;
+unsigned long relayOpenTime;
+uint8_t relayOpen = false;
+
+void setup()
+{
+  Serial.begin(9600);
+  pinMode(buttonPin, INPUT_PULLUP);
+  pinMode(relayPin, OUTPUT);
+  pinMode(ledPin, OUTPUT);
+
+  Ethernet.begin(mac, ip, gateway);
+  Udp.begin(localPort);
+  delay(1000); // Lets the Ethernet card get set up.
+}
+
+void loop()
+{
+  radius.poll();
+
+  // Button pressed and no request outstanding: ask the RADIUS server
+  if (handle < 0 && digitalRead(buttonPin) == LOW)
+  {
+    msg = RadiusMsg(RadiusCodeAccessRequest);
+    msg.addAttr(RadiusAttrUserName, 0, user);
+    msg.addAttr(RadiusAttrUserPassword, 0, password);
+    msg.sign(secret, strlen(secret));
+    handle = radius.begin(&msg, &reply);
+  }
+
+  // Finished with the request?
+  if (handle >= 0 && radius.status(handle) != RadiusUdpStatusPending)
+  {
+    if (   radius.status(handle) == RadiusUdpStatusReplied
+	&& reply.checkAuthenticatorsWithOriginal(secret, strlen(secret), &msg)
+	&& reply.code() == RadiusCodeAccessAccept)
+    {
+      Serial.println("Got Access-Accept");
+      digitalWrite(relayPin, HIGH);
+      relayOpen = true;
+      relayOpenTime = millis();
+    }
+    else
+    {
+      Serial.println("No Access-Accept");
+    }
+    radius.release(handle);
+    handle = -1;
+  }
+
+  // Close the door again after 5 seconds
+  if (relayOpen && millis() - relayOpenTime >= 5000)
+  {
+    digitalWrite(relayPin, LOW);
+    relayOpen = false;
+  }
+
+  // Blink the status LED, to show loop() is still running
+  digitalWrite(ledPin, (millis() / 500) & 1);
+
+  // Sleep until the next interrupt, at most a millisecond, to save power
+  RadiusMsg::sleepIdle();
+}